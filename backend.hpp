@@ -0,0 +1,292 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ollama.hpp"
+#include "generation_options.hpp"
+#include "llamacpp_client/llama_client.hpp"
+
+// Server-side numbers of the last generation, zero when the server doesn't report them.
+struct GenerationStats {
+    int promptTokens = 0;
+    int cachedPromptTokens = 0;
+    int generatedTokens = 0;
+    double promptMs = 0;
+    double generationMs = 0;
+};
+
+// A server that generates text for a prompt. Every instance holds its own connection, so instances can be
+// used from different threads at the same time, but a single instance serves one generation at a time.
+class LLMBackend {
+public:
+    using TokenCallback = std::function<void(const std::string &)>;
+
+    virtual ~LLMBackend() = default;
+
+    virtual std::string name() const = 0;
+
+    // streams the response piece by piece to onToken, returns false if the request failed or was cancelled
+    virtual bool generate(const std::string &model, const std::string &prompt, const GenerationOptions &options,
+                          const TokenCallback &onToken) = 0;
+
+    // empty when the server can't tokenize
+    virtual std::vector<int> tokenize(const std::string &model, const std::string &text) = 0;
+
+    virtual int countTokens(const std::string &model, const std::string &text) {
+        return tokenize(model, text).size();
+    }
+
+    // aborts the generation currently running in another thread (or in onToken)
+    virtual void cancel() = 0;
+
+    virtual bool healthy() = 0;
+
+    virtual GenerationStats lastStats() const = 0;
+
+    // false when the last failed generation was refused for the request itself (e.g. a prompt longer than the
+    // context), another server would refuse it too; no answer or a server error can be tried elsewhere
+    virtual bool lastFailureRetryable() const {
+        return true;
+    }
+
+    // the server that answered the last request, for the logs; empty when there is only one
+    virtual std::string endpoint() const {
+        return "";
+    }
+
+    // requests sharing a key share most of their prompt, servers with several slots keep them on one
+    virtual void setAffinityKey(const std::string &key) {}
+
+    // saves the server's cache of the affinity key's prompts to file (a name, the server decides the directory) or
+    // loads it back, e.g. after the server restarted; false when the server can't
+    virtual bool saveCache(const std::string &file) {
+        return false;
+    }
+
+    virtual bool restoreCache(const std::string &file) {
+        return false;
+    }
+};
+
+class OllamaBackend : public LLMBackend {
+    ollama::Ollama server;
+    std::atomic<bool> cancelled = false;
+    GenerationStats stats;
+
+    // the response is a single object whose only field is the translation unit, generation ends with the object
+    static ollama::json codeOnlySchema() {
+        return {
+            {"type", "object"},
+            {"properties", {{"code", {{"type", "string"}}}}},
+            {"required", {"code"}}
+        };
+    }
+
+    // the model may still stop early (e.g. on the length limit), keep whatever arrived so compilation reports it
+    static std::string extractCode(const std::string &response) {
+        ollama::json parsed = ollama::json::parse(response, nullptr, false);
+        if (parsed.is_object() && parsed.contains("code") && parsed["code"].is_string()) {
+            return parsed["code"];
+        }
+        return response;
+    }
+
+    static ollama::options toOllamaOptions(const GenerationOptions &options) {
+        ollama::options ollamaOptions;
+        ollama::json fields = options.toOllama();
+        for (const auto &[key, value]: fields.items()) {
+            ollamaOptions[key] = value;
+        }
+        return ollamaOptions;
+    }
+
+    void readStats(const ollama::json &response) {
+        stats.promptTokens = response.value("prompt_eval_count", 0);
+        stats.generatedTokens = response.value("eval_count", 0);
+        // durations are reported in nanoseconds
+        stats.promptMs = response.value("prompt_eval_duration", 0.0) / 1e6;
+        stats.generationMs = response.value("eval_duration", 0.0) / 1e6;
+    }
+
+public:
+    std::string url;
+
+    OllamaBackend(std::string url = "http://localhost:11434") : server(url), url(url) {}
+
+    std::string name() const override {
+        return "ollama";
+    }
+
+    bool generate(const std::string &model, const std::string &prompt, const GenerationOptions &options,
+                  const TokenCallback &onToken) override {
+        cancelled = false;
+        stats = GenerationStats();
+        ollama::request request(model, prompt, toOllamaOptions(options), true);
+        // structured output arrives as a JSON document, the code is only usable once it is complete
+        std::string structured;
+        if (options.codeOnly) {
+            request["format"] = codeOnlySchema();
+        }
+        bool done = false;
+        try {
+            // returning false from the callback stops the stream
+            bool ok = server.generate(request, [&](const ollama::response &response) {
+                if (cancelled) {
+                    return false;
+                }
+                if (options.codeOnly) {
+                    structured += response.as_simple_string();
+                } else {
+                    onToken(response.as_simple_string());
+                }
+                if (response.as_json().value("done", false)) {
+                    readStats(response.as_json());
+                    done = true;
+                }
+                return !cancelled;
+            });
+            if (!ok || !done) {
+                return false;
+            }
+        } catch (const ollama::exception &e) {
+            // a stopped stream is reported as a failed request too
+            if (!cancelled) {
+                std::cerr << "ollama request failed: " << e.what() << std::endl;
+            }
+            return false;
+        }
+        if (options.codeOnly) {
+            onToken(extractCode(structured));
+        }
+        return !cancelled;
+    }
+
+    // ollama has no tokenizer endpoint
+    std::vector<int> tokenize(const std::string &model, const std::string &text) override {
+        return {};
+    }
+
+    // rough estimate for code and English text with the usual BPE vocabularies
+    int countTokens(const std::string &model, const std::string &text) override {
+        return text.size() / 4 + 1;
+    }
+
+    void cancel() override {
+        cancelled = true;
+    }
+
+    bool healthy() override {
+        return server.is_running();
+    }
+
+    GenerationStats lastStats() const override {
+        return stats;
+    }
+};
+
+class LlamaCppBackend : public LLMBackend {
+    LLamaClient client;
+    int slot = -1;
+
+    // the grammar makes the response a single fenced block, the code inside is passed on as ollama's structured output is
+    static std::string stripFence(const std::string &response) {
+        size_t begin = response.rfind("```", 0) == 0 ? response.find('\n') : std::string::npos;
+        if (begin == std::string::npos) {
+            return response;
+        }
+        size_t end = response.rfind("```");
+        end = end > begin ? end : response.size();
+        return response.substr(begin + 1, end - begin - 1);
+    }
+
+public:
+    std::string hostAddress;
+
+    // hostAddress is host:port, the client adds the scheme itself
+    LlamaCppBackend(std::string hostAddress = "127.0.0.1:8080", int slotCount = 1) : client(hostAddress), hostAddress(hostAddress) {
+        client.slotCount = slotCount;
+    }
+
+    std::string name() const override {
+        return "llama.cpp";
+    }
+
+    // llama.cpp serves the single model it was started with, model is ignored
+    bool generate(const std::string &model, const std::string &prompt, const GenerationOptions &options,
+                  const TokenCallback &onToken) override {
+        client.grammar = options.codeOnly ? LLamaClient::cppCodeBlockGrammar : "";
+        // like structured output, the code is only usable once it is complete
+        client.onContent = [&](const std::string &piece) {
+            if (!options.codeOnly) {
+                onToken(piece);
+            }
+        };
+        bool ok = true;
+        std::string response = client.prompt(prompt, options, slot, &ok);
+        if (options.codeOnly) {
+            onToken(stripFence(response));
+        }
+        return ok;
+    }
+
+    std::vector<int> tokenize(const std::string &model, const std::string &text) override {
+        return client.tokenize(text);
+    }
+
+    // falls back to the estimate when the server didn't answer
+    int countTokens(const std::string &model, const std::string &text) override {
+        std::vector<int> tokens = client.tokenize(text);
+        return tokens.empty() && !text.empty() ? text.size() / 4 + 1 : tokens.size();
+    }
+
+    void cancel() override {
+        client.cancel();
+    }
+
+    bool healthy() override {
+        return client.healthy();
+    }
+
+    GenerationStats lastStats() const override {
+        const PromptTimings &timings = client.lastTimings();
+        GenerationStats stats;
+        stats.promptTokens = timings.tokensEvaluated;
+        stats.cachedPromptTokens = timings.tokensCached;
+        stats.generatedTokens = timings.predictedN;
+        stats.promptMs = timings.promptMs;
+        stats.generationMs = timings.predictedMs;
+        return stats;
+    }
+
+    bool lastFailureRetryable() const override {
+        long status = client.lastStatus();
+        return status < 400 || status >= 500;
+    }
+
+    void setAffinityKey(const std::string &key) override {
+        slot = client.slotFor(key);
+    }
+
+    // needs a server started with --slot-save-path
+    bool saveCache(const std::string &file) override {
+        return slot >= 0 && client.saveSlot(slot, file);
+    }
+
+    bool restoreCache(const std::string &file) override {
+        return slot >= 0 && client.restoreSlot(slot, file);
+    }
+};
+
+// kind is "ollama" or "llamacpp", url the server address (empty for the default one)
+inline std::unique_ptr<LLMBackend> makeBackend(const std::string &kind, const std::string &url, int slotCount = 1) {
+    if (kind == "ollama") {
+        return url.empty() ? std::make_unique<OllamaBackend>() : std::make_unique<OllamaBackend>(url);
+    }
+    if (kind == "llamacpp" || kind == "llama.cpp") {
+        return std::make_unique<LlamaCppBackend>(url.empty() ? "127.0.0.1:8080" : url, slotCount);
+    }
+    return nullptr;
+}
@@ -0,0 +1,325 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "backend.hpp"
+#include "hashing.hpp"
+
+// Several servers of the same kind (e.g. llama.cpp servers pinned to different CPU sockets) shared by all threads.
+// A request goes to the endpoint with the fewest requests running; an endpoint failing a health check is left out
+// until it passes one again, and one failing failuresToOpen requests in a row is left out for cooldownSeconds
+// (circuit breaker), after that a single request tries it again.
+class BackendPool {
+public:
+    using Factory = std::function<std::unique_ptr<LLMBackend>(const std::string &url)>;
+
+    struct Settings {
+        int failuresToOpen = 3;
+        double cooldownSeconds = 30;
+        // 0 for no health checks
+        double healthCheckSeconds = 10;
+    };
+
+private:
+    struct Endpoint {
+        std::string url;
+        int outstanding = 0;
+        bool down = false;
+        int failuresInRow = 0;
+        std::chrono::steady_clock::time_point openUntil;
+        bool probing = false;
+
+        int requests = 0;
+        int failures = 0;
+        long long generatedTokens = 0;
+        double busyMs = 0;
+    };
+
+    Factory factory;
+    Settings settings;
+    // the name of the endpoints' backends
+    std::string kind = "pool";
+    mutable std::mutex mutex;
+    std::vector<Endpoint> endpoints;
+    // the endpoint that last answered a request of every affinity key, its server has the key's prompt cached
+    std::map<uint64_t, int> servedBy;
+
+    std::condition_variable stopped;
+    bool stopping = false;
+    std::thread healthChecker;
+
+    bool open(const Endpoint &endpoint, std::chrono::steady_clock::time_point now) const {
+        return endpoint.failuresInRow >= settings.failuresToOpen && (now < endpoint.openUntil || endpoint.probing);
+    }
+
+    void checkHealth() {
+        std::vector<std::unique_ptr<LLMBackend>> checkers;
+        for (const Endpoint &endpoint: endpoints) {
+            checkers.push_back(factory(endpoint.url));
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopped.wait_for(lock, std::chrono::duration<double>(settings.healthCheckSeconds), [this] { return stopping; })) {
+            lock.unlock();
+            std::vector<bool> healthy;
+            for (auto &checker: checkers) {
+                healthy.push_back(checker && checker->healthy());
+            }
+            lock.lock();
+            for (size_t i = 0; i < endpoints.size(); i++) {
+                endpoints[i].down = !healthy[i];
+            }
+        }
+    }
+
+public:
+    BackendPool(std::vector<std::string> urls, Factory factory, Settings settings)
+            : factory(std::move(factory)), settings(settings) {
+        for (std::string &url: urls) {
+            endpoints.push_back({std::move(url)});
+        }
+        if (std::unique_ptr<LLMBackend> backend = endpoints.empty() ? nullptr : this->factory(endpoints[0].url)) {
+            kind = backend->name();
+        }
+        if (settings.healthCheckSeconds > 0) {
+            healthChecker = std::thread(&BackendPool::checkHealth, this);
+        }
+    }
+
+    BackendPool(const BackendPool &) = delete;
+    BackendPool &operator=(const BackendPool &) = delete;
+
+    ~BackendPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        stopped.notify_all();
+        if (healthChecker.joinable()) {
+            healthChecker.join();
+        }
+    }
+
+    size_t size() const {
+        return endpoints.size();
+    }
+
+    const std::string &name() const {
+        return kind;
+    }
+
+    const std::string &url(size_t endpoint) const {
+        return endpoints[endpoint].url;
+    }
+
+    std::unique_ptr<LLMBackend> connect(size_t endpoint) const {
+        return factory(endpoints[endpoint].url);
+    }
+
+    // the endpoint with the fewest running requests that is up and not tried yet, ties go to the one the affinity
+    // hash points at so requests sharing a prompt prefix stay on one server; when all are down or open the least
+    // busy one is tried anyway. -1 when every endpoint was tried.
+    int acquire(uint64_t affinity, const std::vector<bool> &tried) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        int chosen = -1;
+        bool chosenAvailable = false;
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            size_t index = (affinity + i) % endpoints.size();
+            const Endpoint &endpoint = endpoints[index];
+            if (tried[index]) {
+                continue;
+            }
+            bool available = !endpoint.down && !open(endpoint, now);
+            if (chosen < 0 || (available && !chosenAvailable) ||
+                (available == chosenAvailable && endpoint.outstanding < endpoints[chosen].outstanding)) {
+                chosen = index;
+                chosenAvailable = available;
+            }
+        }
+        if (chosen >= 0) {
+            Endpoint &endpoint = endpoints[chosen];
+            endpoint.outstanding++;
+            endpoint.requests++;
+            // the trial request of an open circuit, the others keep away until it is back
+            if (endpoint.failuresInRow >= settings.failuresToOpen) {
+                endpoint.probing = true;
+            }
+        }
+        return chosen;
+    }
+
+    void served(uint64_t affinity, int endpoint) {
+        std::lock_guard<std::mutex> lock(mutex);
+        servedBy[affinity] = endpoint;
+    }
+
+    // the endpoint with the prompt cache of the affinity key, the one it prefers when none answered it yet
+    int cachedOn(uint64_t affinity) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = servedBy.find(affinity);
+        return found != servedBy.end() ? found->second : affinity % endpoints.size();
+    }
+
+    // failures say something about the endpoint only when counted, not when the request was cancelled or refused
+    // for itself
+    void release(int index, bool ok, bool countFailure, int generatedTokens, double ms) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Endpoint &endpoint = endpoints[index];
+        endpoint.outstanding--;
+        endpoint.probing = false;
+        endpoint.busyMs += ms;
+        endpoint.generatedTokens += generatedTokens;
+        if (ok) {
+            endpoint.failuresInRow = 0;
+        } else if (countFailure) {
+            endpoint.failures++;
+            if (++endpoint.failuresInRow >= settings.failuresToOpen) {
+                endpoint.openUntil = std::chrono::steady_clock::now() +
+                                     std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(settings.cooldownSeconds));
+            }
+        }
+    }
+
+    void printStats(std::ostream &out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        out << std::left << std::setw(24) << "endpoint" << std::right << std::setw(10) << "requests" << std::setw(10)
+            << "failures" << std::setw(11) << "generated" << std::setw(8) << "tok/s" << std::setw(8) << "state" << '\n';
+        for (const Endpoint &endpoint: endpoints) {
+            out << std::left << std::setw(24) << endpoint.url << std::right << std::setw(10) << endpoint.requests << std::setw(10)
+                << endpoint.failures << std::setw(11) << endpoint.generatedTokens << std::setw(8) << std::fixed << std::setprecision(1)
+                << (endpoint.busyMs > 0 ? endpoint.generatedTokens * 1000 / endpoint.busyMs : 0) << std::defaultfloat << std::setw(8)
+                << (endpoint.down ? "down" : open(endpoint, now) ? "open" : "up") << '\n';
+        }
+    }
+};
+
+// The backend of one thread over a shared pool, with a connection of its own to every endpoint it used. A request
+// that fails before anything was streamed is tried again on the next endpoint, unless the server refused the
+// request itself.
+class PooledBackend : public LLMBackend {
+    BackendPool &pool;
+    std::vector<std::unique_ptr<LLMBackend>> connections;
+    uint64_t affinity = 0;
+    std::string affinityKey;
+    int last = -1;
+    std::atomic<LLMBackend *> active = nullptr;
+    std::atomic<bool> cancelled = false;
+
+    LLMBackend &connection(size_t endpoint) {
+        if (!connections[endpoint]) {
+            connections[endpoint] = pool.connect(endpoint);
+            if (!affinityKey.empty()) {
+                connections[endpoint]->setAffinityKey(affinityKey);
+            }
+        }
+        return *connections[endpoint];
+    }
+
+public:
+    explicit PooledBackend(BackendPool &pool) : pool(pool), connections(pool.size()) {}
+
+    // the same whichever endpoint answers, the response cache keys on it
+    std::string name() const override {
+        return pool.name();
+    }
+
+    bool generate(const std::string &model, const std::string &prompt, const GenerationOptions &options,
+                  const TokenCallback &onToken) override {
+        cancelled = false;
+        std::vector<bool> tried(pool.size());
+        int endpoint;
+        while ((endpoint = pool.acquire(affinity, tried)) >= 0) {
+            tried[endpoint] = true;
+            last = endpoint;
+            LLMBackend &backend = connection(endpoint);
+            active = &backend;
+            bool streamed = false;
+            auto start = std::chrono::steady_clock::now();
+            bool ok = !cancelled && backend.generate(model, prompt, options, [&](const std::string &piece) {
+                streamed = true;
+                onToken(piece);
+            });
+            active = nullptr;
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            bool retryable = !ok && !cancelled && backend.lastFailureRetryable();
+            pool.release(endpoint, ok, retryable, ok ? backend.lastStats().generatedTokens : 0, ms);
+            if (ok) {
+                pool.served(affinity, endpoint);
+            }
+            if (!retryable || streamed) {
+                return ok;
+            }
+        }
+        return false;
+    }
+
+    // all endpoints serve the same model, so any of them tokenizes the same way
+    std::vector<int> tokenize(const std::string &model, const std::string &text) override {
+        return connection(last >= 0 ? last : affinity % pool.size()).tokenize(model, text);
+    }
+
+    int countTokens(const std::string &model, const std::string &text) override {
+        return connection(last >= 0 ? last : affinity % pool.size()).countTokens(model, text);
+    }
+
+    void cancel() override {
+        cancelled = true;
+        if (LLMBackend *backend = active) {
+            backend->cancel();
+        }
+    }
+
+    // reachable when any endpoint is
+    bool healthy() override {
+        for (size_t endpoint = 0; endpoint < pool.size(); endpoint++) {
+            if (connection(endpoint).healthy()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    GenerationStats lastStats() const override {
+        return last < 0 ? GenerationStats() : connections[last]->lastStats();
+    }
+
+    bool lastFailureRetryable() const override {
+        return last < 0 || connections[last]->lastFailureRetryable();
+    }
+
+    std::string endpoint() const override {
+        return last < 0 ? "" : pool.url(last);
+    }
+
+    void setAffinityKey(const std::string &key) override {
+        affinityKey = key;
+        affinity = fnv1a(key);
+        for (auto &connection: connections) {
+            if (connection) {
+                connection->setAffinityKey(key);
+            }
+        }
+    }
+
+    // kept on the endpoint that answered the affinity key's last request, which may be another one than it prefers
+    // when that was busy or down; the slots are saved from any backend of the pool, not only the one that generated
+    bool saveCache(const std::string &file) override {
+        return connection(pool.cachedOn(affinity)).saveCache(file);
+    }
+
+    bool restoreCache(const std::string &file) override {
+        return connection(pool.cachedOn(affinity)).restoreCache(file);
+    }
+};
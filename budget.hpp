@@ -0,0 +1,100 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <optional>
+#include <string>
+
+// Limits of the work spent on one problem, 0 means no limit.
+struct Budget {
+    int maxTries = 0;
+    double maxSeconds = 0;
+    long long maxGeneratedTokens = 0;
+    // CPU time (user and system) of the solutions running on the tests
+    double maxTestCpuSeconds = 0;
+};
+
+// What one problem used so far, checked between rounds. The wall time and the test CPU time also bound the round
+// that is running: it is cancelled at the deadline and every test run gets the CPU time that is left.
+class BudgetTracker {
+    Budget budget;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int tries = 0;
+    long long generatedTokens = 0;
+    double testCpuSeconds = 0;
+
+public:
+    explicit BudgetTracker(Budget budget) : budget(budget) {}
+
+    void addRound(long long tokens, double cpuSeconds) {
+        tries++;
+        generatedTokens += tokens;
+        testCpuSeconds += cpuSeconds;
+    }
+
+    // continues from what a resumed session had used
+    void restore(int rounds, long long tokens, double cpuSeconds, double seconds) {
+        tries = rounds;
+        generatedTokens = tokens;
+        testCpuSeconds = cpuSeconds;
+        start = std::chrono::steady_clock::now() - std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(seconds));
+    }
+
+    double seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    int rounds() const {
+        return tries;
+    }
+
+    long long tokens() const {
+        return generatedTokens;
+    }
+
+    double cpuSeconds() const {
+        return testCpuSeconds;
+    }
+
+    // when the wall time runs out, nullopt without a limit
+    std::optional<std::chrono::steady_clock::time_point> deadline() const {
+        if (budget.maxSeconds <= 0) {
+            return std::nullopt;
+        }
+        return start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(budget.maxSeconds));
+    }
+
+    // the CPU time the tests may still use, 0 without a limit
+    double testCpuSecondsLeft() const {
+        return budget.maxTestCpuSeconds > 0 ? std::max(budget.maxTestCpuSeconds - testCpuSeconds, 1e-3) : 0;
+    }
+
+    // the limits that also stop a running round: the wall time or the test CPU time ran out
+    bool timeOrCpuExhausted() const {
+        return (budget.maxSeconds > 0 && seconds() >= budget.maxSeconds) ||
+               (budget.maxTestCpuSeconds > 0 && testCpuSeconds >= budget.maxTestCpuSeconds);
+    }
+
+    // CPU time of the checks against the reference solution between rounds
+    void addTestCpu(double cpuSeconds) {
+        testCpuSeconds += cpuSeconds;
+    }
+
+    // the reason to stop, nullopt while everything is within the budget
+    std::optional<std::string> exhausted() const {
+        if (budget.maxTries > 0 && tries >= budget.maxTries) {
+            return "used all " + std::to_string(budget.maxTries) + " rounds";
+        }
+        if (budget.maxSeconds > 0 && seconds() >= budget.maxSeconds) {
+            return "ran out of time after " + std::to_string((int) seconds()) + " s";
+        }
+        if (budget.maxGeneratedTokens > 0 && generatedTokens >= budget.maxGeneratedTokens) {
+            return "generated " + std::to_string(generatedTokens) + " tokens";
+        }
+        if (budget.maxTestCpuSeconds > 0 && testCpuSeconds >= budget.maxTestCpuSeconds) {
+            return "tests used " + std::to_string((int) testCpuSeconds) + " CPU seconds";
+        }
+        return std::nullopt;
+    }
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+struct CascadeStep {
+    std::string model;
+    // attempts before moving on to the next model (at least one), ignored for the last one
+    int maxAttempts;
+};
+
+// Starts with the first (small and fast) model and moves to the next, bigger one when the current one
+// used up its attempts or keeps failing the same way. The last model is used until the problem is solved.
+class ModelCascade {
+public:
+    struct ModelStats {
+        int attempts = 0;
+        int solved = 0;
+        // the generations of the model's candidates
+        int calls = 0;
+        double callMs = 0;
+    };
+
+private:
+    std::vector<CascadeStep> steps;
+    int repeatsBeforeEscalation;
+    size_t current = 0;
+    int attemptsOnCurrent = 0;
+
+    mutable std::mutex mutex;
+    std::map<std::string, ModelStats> stats;
+
+public:
+    ModelCascade(std::vector<CascadeStep> steps, int repeatsBeforeEscalation = 3)
+            : steps(steps), repeatsBeforeEscalation(repeatsBeforeEscalation) {
+        // a model given without a number of attempts gets one
+        for (CascadeStep &step: this->steps) {
+            step.maxAttempts = std::max(step.maxAttempts, 1);
+        }
+    }
+
+    const std::string &model() const {
+        return steps[current].model;
+    }
+
+    // returns true when the failure moved the cascade to the next model
+    bool afterFailure(int repeatedFailures) {
+        attemptsOnCurrent++;
+        if (current + 1 >= steps.size()) {
+            return false;
+        }
+        if (attemptsOnCurrent >= steps[current].maxAttempts || repeatedFailures + 1 >= repeatsBeforeEscalation) {
+            current++;
+            attemptsOnCurrent = 0;
+            return true;
+        }
+        return false;
+    }
+
+    // where the cascade is, for resuming a session with restore
+    size_t step() const {
+        return current;
+    }
+
+    int attemptsOnStep() const {
+        return attemptsOnCurrent;
+    }
+
+    void restore(size_t step, int attempts) {
+        current = std::min(step, steps.size() - 1);
+        attemptsOnCurrent = attempts;
+    }
+
+    void recordAttempt(const std::string &model, bool solved) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats[model].attempts++;
+        stats[model].solved += solved;
+    }
+
+    void recordCall(const std::string &model, double ms) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats[model].calls++;
+        stats[model].callMs += ms;
+    }
+
+    std::map<std::string, ModelStats> modelStats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    // adds what another cascade of the same models counted, e.g. for the report over all problems of a batch
+    void addStats(const std::map<std::string, ModelStats> &other) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto &[model, counted]: other) {
+            ModelStats &total = stats[model];
+            total.attempts += counted.attempts;
+            total.solved += counted.solved;
+            total.calls += counted.calls;
+            total.callMs += counted.callMs;
+        }
+    }
+
+    std::string describe() const {
+        std::string description;
+        for (size_t i = 0; i < steps.size(); i++) {
+            description += steps[i].model;
+            if (i + 1 < steps.size()) {
+                description += " (" + std::to_string(steps[i].maxAttempts) + (steps[i].maxAttempts == 1 ? " attempt) -> " : " attempts) -> ");
+            }
+        }
+        return description;
+    }
+
+    // solve rate and generation latency of every model that was used
+    void printReport(std::ostream &out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        out << std::left << std::setw(24) << "model" << std::right << std::setw(10) << "attempts" << std::setw(8) << "solved"
+            << std::setw(12) << "solve rate" << std::setw(14) << "avg call [s]" << '\n';
+        for (const CascadeStep &step: steps) {
+            auto found = stats.find(step.model);
+            if (found == stats.end()) {
+                continue;
+            }
+            const ModelStats &model = found->second;
+            out << std::left << std::setw(24) << step.model << std::right << std::setw(10) << model.attempts
+                << std::setw(8) << model.solved << std::fixed << std::setprecision(2)
+                << std::setw(12) << (model.attempts ? (double) model.solved / model.attempts : 0.0)
+                << std::setw(14) << (model.calls ? model.callMs / model.calls / 1000 : 0.0) << std::defaultfloat << '\n';
+        }
+    }
+};
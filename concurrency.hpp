@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Limits how many threads use a resource (LLM slots, CPU cores) at once.
+class Semaphore {
+    std::mutex mutex;
+    std::condition_variable released;
+    int available;
+
+public:
+    explicit Semaphore(int count) : available(count) {}
+
+    void acquire() {
+        std::unique_lock<std::mutex> lock(mutex);
+        released.wait(lock, [this] { return available > 0; });
+        available--;
+    }
+
+    // takes at most count units that are free now without waiting, returns how many it took
+    int tryAcquire(int count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int taken = std::max(0, std::min(count, available));
+        available -= taken;
+        return taken;
+    }
+
+    void release(int count = 1) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            available += count;
+        }
+        if (count == 1) {
+            released.notify_one();
+        } else {
+            released.notify_all();
+        }
+    }
+};
+
+// holds one unit of the semaphore while in scope, without a semaphore there is no limit
+class SemaphoreGuard {
+    Semaphore *semaphore;
+
+public:
+    explicit SemaphoreGuard(Semaphore *semaphore) : semaphore(semaphore) {
+        if (semaphore) {
+            semaphore->acquire();
+        }
+    }
+
+    SemaphoreGuard(const SemaphoreGuard &) = delete;
+    SemaphoreGuard &operator=(const SemaphoreGuard &) = delete;
+
+    ~SemaphoreGuard() {
+        if (semaphore) {
+            semaphore->release();
+        }
+    }
+};
+
+// holds the units of the semaphore that were free when it was created, at most count of them, for work that can use
+// more threads but shouldn't wait for them; without a semaphore it holds count
+class SemaphoreShare {
+    Semaphore *semaphore;
+    int held;
+
+public:
+    SemaphoreShare(Semaphore *semaphore, int count) : semaphore(semaphore), held(semaphore ? semaphore->tryAcquire(count) : count) {}
+
+    SemaphoreShare(const SemaphoreShare &) = delete;
+    SemaphoreShare &operator=(const SemaphoreShare &) = delete;
+
+    ~SemaphoreShare() {
+        if (semaphore && held > 0) {
+            semaphore->release(held);
+        }
+    }
+
+    int count() const {
+        return held;
+    }
+};
+
+// A queue of at most capacity items, push waits while it is full so a fast stage can't run away from a slow one.
+template<typename T>
+class BoundedQueue {
+    std::mutex mutex;
+    std::condition_variable notFull;
+    std::condition_variable notEmpty;
+    std::deque<std::pair<T, std::chrono::steady_clock::time_point>> items;
+    size_t capacity;
+    bool closed = false;
+
+    // depth seen by every push and the time items waited to be taken
+    size_t pushes = 0;
+    size_t depthSum = 0;
+    size_t depthMax = 0;
+    double waitedMs = 0;
+
+public:
+    explicit BoundedQueue(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    // false when the queue is closed
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.emplace_back(std::move(item), std::chrono::steady_clock::now());
+        pushes++;
+        depthSum += items.size();
+        depthMax = std::max(depthMax, items.size());
+        lock.unlock();
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // nullopt once the queue is closed and empty
+    std::optional<T> pop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return std::nullopt;
+        }
+        T item = std::move(items.front().first);
+        waitedMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - items.front().second).count();
+        items.pop_front();
+        lock.unlock();
+        notFull.notify_one();
+        return item;
+    }
+
+    // the items already queued are still handed out
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    double averageDepth() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return pushes ? (double) depthSum / pushes : 0;
+    }
+
+    size_t maxDepth() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return depthMax;
+    }
+
+    double averageWaitMs() {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t popped = pushes - items.size();
+        return popped ? waitedMs / popped : 0;
+    }
+};
+
+// One step of a pipeline: workers take items from the stage's queue and process them, usually ending with a
+// submit to the next stage. Stopping closes the queue and waits until everything queued is processed.
+template<typename T>
+class Stage {
+    std::string stageName;
+    BoundedQueue<T> queue;
+    std::function<void(T &)> process;
+    std::vector<std::thread> workers;
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    std::atomic<long long> busyMicroseconds = 0;
+    std::atomic<int> processed = 0;
+
+    void work() {
+        while (std::optional<T> item = queue.pop()) {
+            auto start = std::chrono::steady_clock::now();
+            process(*item);
+            busyMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+            processed++;
+        }
+    }
+
+public:
+    Stage(std::string name, int workerCount, size_t capacity, std::function<void(T &)> process)
+            : stageName(std::move(name)), queue(capacity), process(std::move(process)) {
+        for (int i = 0; i < std::max(workerCount, 1); i++) {
+            workers.emplace_back(&Stage::work, this);
+        }
+    }
+
+    Stage(const Stage &) = delete;
+    Stage &operator=(const Stage &) = delete;
+
+    ~Stage() {
+        stop();
+    }
+
+    bool submit(T item) {
+        return queue.push(std::move(item));
+    }
+
+    void stop() {
+        queue.close();
+        for (std::thread &worker: workers) {
+            if (worker.joinable()) {
+                worker.join();
+            }
+        }
+    }
+
+    // share of the workers' time spent processing since the stage started
+    double utilisation() const {
+        double elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+        return elapsed > 0 ? busyMicroseconds / (elapsed * workers.size()) : 0;
+    }
+
+    void printStats(std::ostream &out) {
+        out << std::left << std::setw(12) << stageName << std::right << std::setw(8) << workers.size() << std::setw(8) << processed
+            << std::fixed << std::setprecision(1) << std::setw(10) << utilisation() * 100 << std::setw(12) << queue.averageWaitMs()
+            << std::setw(10) << queue.averageDepth() << std::defaultfloat << std::setw(10) << queue.maxDepth() << '\n';
+    }
+
+    static void printHeader(std::ostream &out) {
+        out << std::left << std::setw(12) << "stage" << std::right << std::setw(8) << "workers" << std::setw(8) << "items"
+            << std::setw(10) << "busy [%]" << std::setw(12) << "wait [ms]" << std::setw(10) << "avg queue" << std::setw(10)
+            << "max queue" << '\n';
+    }
+};
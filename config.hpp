@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Command line options (--name value, --name=value, --flag, --flag true/false) bound to variables, the same names can
+// be given in a config file as name = value lines. Options are applied in the order they appear, so --config file followed by
+// other options overrides the file and the other way round.
+class OptionParser {
+    struct Option {
+        std::string name;
+        std::string value;  // what the option takes for the help, empty for a flag
+        std::string help;
+        std::function<bool(const std::string &)> set;
+    };
+    std::vector<Option> options;
+
+    template<typename T>
+    struct IsOptional : std::false_type {};
+
+    template<typename T>
+    struct IsOptional<std::optional<T>> : std::true_type {};
+
+    template<typename T>
+    static bool parse(const std::string &text, T &target) {
+        if constexpr (std::is_same_v<T, std::string>) {
+            target = text;
+            return true;
+        } else if constexpr (std::is_same_v<T, bool>) {
+            if (text == "" || text == "true" || text == "1" || text == "yes") {
+                target = true;
+            } else if (text == "false" || text == "0" || text == "no") {
+                target = false;
+            } else {
+                return false;
+            }
+            return true;
+        } else if constexpr (IsOptional<T>::value) {
+            typename T::value_type value;
+            if (!parse(text, value)) {
+                return false;
+            }
+            target = value;
+            return true;
+        } else {
+            std::istringstream stream(text);
+            T value;
+            if (!(stream >> value) || !stream.eof()) {
+                return false;
+            }
+            target = value;
+            return true;
+        }
+    }
+
+    const Option *find(const std::string &name) const {
+        for (const Option &option: options) {
+            if (option.name == name) {
+                return &option;
+            }
+        }
+        return nullptr;
+    }
+
+    bool apply(const std::string &name, const std::string &value, std::string &error) {
+        const Option *option = find(name);
+        if (!option) {
+            error = "unknown option " + name;
+            return false;
+        }
+        if (!option->set(value)) {
+            error = "invalid value '" + value + "' for " + name;
+            return false;
+        }
+        return true;
+    }
+
+public:
+    template<typename T>
+    void add(const std::string &name, T &target, const std::string &help) {
+        std::string value = std::is_same_v<T, bool> ? "" : std::is_same_v<T, std::string> ? "TEXT" : "N";
+        options.push_back({name, value, help, [&target](const std::string &text) { return parse(text, target); }});
+    }
+
+    // for values that need more than a conversion, set returns false for an invalid value
+    void add(const std::string &name, const std::string &value, std::function<bool(const std::string &)> set,
+             const std::string &help) {
+        options.push_back({name, value, help, std::move(set)});
+    }
+
+    // name = value lines, # starts a comment
+    bool parseFile(const std::string &path, std::string &error) {
+        std::ifstream file(path);
+        if (!file) {
+            error = "couldn't open the config file " + path;
+            return false;
+        }
+        std::string line;
+        for (int number = 1; std::getline(file, line); number++) {
+            line = line.substr(0, line.find('#'));
+            size_t equals = line.find('=');
+            auto trim = [](std::string text) {
+                size_t begin = text.find_first_not_of(" \t\r");
+                size_t end = text.find_last_not_of(" \t\r");
+                return begin == std::string::npos ? "" : text.substr(begin, end - begin + 1);
+            };
+            std::string name = trim(line.substr(0, equals));
+            if (name.empty()) {
+                continue;
+            }
+            std::string value = equals == std::string::npos ? "" : trim(line.substr(equals + 1));
+            if (!apply(name, value, error)) {
+                error = path + ":" + std::to_string(number) + ": " + error;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // arguments not starting with -- are returned in positional, --config FILE reads a config file in place
+    bool parseArguments(int argc, char **argv, std::vector<std::string> &positional, std::string &error) {
+        for (int i = 1; i < argc; i++) {
+            std::string argument = argv[i];
+            if (argument.rfind("--", 0) != 0) {
+                positional.push_back(argument);
+                continue;
+            }
+            std::string name = argument.substr(2);
+            std::optional<std::string> value;
+            size_t equals = name.find('=');
+            if (equals != std::string::npos) {
+                value = name.substr(equals + 1);
+                name = name.substr(0, equals);
+            }
+            const Option *option = find(name);
+            bool flag = option && option->value.empty();
+            // a flag takes a following true/false as its value, not as a positional argument
+            bool flagValue = false;
+            if (flag && !value && i + 1 < argc) {
+                static const std::vector<std::string> words = {"true", "false", "yes", "no", "1", "0"};
+                flagValue = std::find(words.begin(), words.end(), argv[i + 1]) != words.end();
+            }
+            if (!value && (name == "config" || (option && !flag) || flagValue)) {
+                if (i + 1 >= argc) {
+                    error = "missing value for --" + name;
+                    return false;
+                }
+                value = argv[++i];
+            }
+            if (name == "config" ? !parseFile(*value, error) : !apply(name, value.value_or(""), error)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void printHelp(std::ostream &out) const {
+        out << "  " << std::left << std::setw(28) << "--config FILE" << " read options from FILE (name = value lines)\n";
+        for (const Option &option: options) {
+            std::string usage = "--" + option.name + (option.value.empty() ? "" : " " + option.value);
+            out << "  " << std::left << std::setw(28) << usage << " " << option.help << '\n';
+        }
+    }
+};
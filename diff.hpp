@@ -0,0 +1,233 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Line diff between the expected and the actual output of a test, compared like diff -b
+// (runs of whitespace are equal, trailing whitespace is ignored, leading whitespace is still whitespace).
+
+struct DiffLine {
+    enum Kind {
+        Same,
+        Missing,  // only in the expected output
+        Extra     // only in the actual output
+    };
+    Kind kind;
+    // indexes into the expected and the actual lines, -1 when the line isn't in that side
+    int expected;
+    int actual;
+};
+
+struct DiffHunk {
+    std::vector<DiffLine> lines;
+};
+
+inline std::vector<std::string> readLines(const std::string &path) {
+    std::vector<std::string> lines;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+inline std::string joinLines(const std::vector<std::string> &lines) {
+    std::string text;
+    for (const std::string &line: lines) {
+        text += line + '\n';
+    }
+    return text;
+}
+
+inline std::string normalizeWhitespace(const std::string &line) {
+    std::string normalized;
+    bool space = false;
+    for (char c: line) {
+        if (c == ' ' || c == '\t' || c == '\r') {
+            space = true;
+            continue;
+        }
+        if (space) {
+            normalized += ' ';
+        }
+        space = false;
+        normalized += c;
+    }
+    return normalized;
+}
+
+// Myers' O((N+M)D) shortest edit script, nullopt when more than maxEdits lines differ; keeps O(maxEdits^2) ints
+inline std::optional<std::vector<DiffLine>> myersDiff(const std::vector<std::string> &a, const std::vector<std::string> &b,
+                                                      int maxEdits) {
+    int n = a.size();
+    int m = b.size();
+    int max = std::min(n + m, maxEdits);
+    int offset = max + 1;
+    std::vector<int> v(2 * max + 3, 0);
+    // the diagonals -d..d of v before every round d, the only ones the walk back reads
+    std::vector<std::vector<int>> trace;
+
+    for (int d = 0; d <= max; d++) {
+        trace.emplace_back(v.begin() + offset - d, v.begin() + offset + d + 1);
+        for (int k = -d; k <= d; k += 2) {
+            int x = k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]) ? v[offset + k + 1] : v[offset + k - 1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                x++;
+                y++;
+            }
+            v[offset + k] = x;
+            if (x < n || y < m) {
+                continue;
+            }
+
+            // walks back through the saved rounds to recover the path
+            std::vector<DiffLine> script;
+            for (int step = d; step >= 0; step--) {
+                const std::vector<int> &previous = trace[step];
+                int k = x - y;
+                int previousK = k == -step || (k != step && previous[step + k - 1] < previous[step + k + 1]) ? k + 1 : k - 1;
+                int previousX = step == 0 ? 0 : previous[step + previousK];
+                int previousY = step == 0 ? 0 : previousX - previousK;
+                while (x > previousX && y > previousY) {
+                    x--;
+                    y--;
+                    script.push_back({DiffLine::Same, x, y});
+                }
+                if (step > 0) {
+                    if (x == previousX) {
+                        script.push_back({DiffLine::Extra, -1, y - 1});
+                    } else {
+                        script.push_back({DiffLine::Missing, x - 1, -1});
+                    }
+                }
+                x = previousX;
+                y = previousY;
+            }
+            std::reverse(script.begin(), script.end());
+            return script;
+        }
+    }
+    return std::nullopt;
+}
+
+// the changed places with context lines around them, at most maxHunks of them; the number of all hunks is
+// stored in totalHunks. Outputs equal up to whitespace are compared as they are, so a difference diff -b saw
+// is still shown. Beyond maxEdits differing lines the outputs are shown as replaced instead of searched.
+inline std::vector<DiffHunk> diffHunks(const std::vector<std::string> &expected, const std::vector<std::string> &actual,
+                                       int context, size_t maxHunks, size_t *totalHunks = nullptr, int maxEdits = 300,
+                                       bool ignoreWhitespace = true) {
+    std::vector<std::string> a;
+    std::vector<std::string> b;
+    for (const std::string &line: expected) {
+        a.push_back(ignoreWhitespace ? normalizeWhitespace(line) : line);
+    }
+    for (const std::string &line: actual) {
+        b.push_back(ignoreWhitespace ? normalizeWhitespace(line) : line);
+    }
+    // an empty last line makes no difference, as with diff -b
+    while (!a.empty() && a.back().empty()) a.pop_back();
+    while (!b.empty() && b.back().empty()) b.pop_back();
+
+    // most wrong answers differ in a few lines, the common beginning and end need no search
+    size_t prefix = 0;
+    while (prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix]) {
+        prefix++;
+    }
+    size_t suffix = 0;
+    while (suffix < a.size() - prefix && suffix < b.size() - prefix && a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix]) {
+        suffix++;
+    }
+    std::vector<std::string> middleA(a.begin() + prefix, a.end() - suffix);
+    std::vector<std::string> middleB(b.begin() + prefix, b.end() - suffix);
+
+    std::vector<DiffLine> script;
+    for (size_t i = 0; i < prefix; i++) {
+        script.push_back({DiffLine::Same, (int) i, (int) i});
+    }
+    if (std::optional<std::vector<DiffLine>> middle = myersDiff(middleA, middleB, maxEdits)) {
+        for (DiffLine line: *middle) {
+            if (line.expected >= 0) line.expected += prefix;
+            if (line.actual >= 0) line.actual += prefix;
+            script.push_back(line);
+        }
+    } else {
+        // too different to search, the whole middle is shown as replaced
+        for (size_t i = 0; i < middleA.size(); i++) {
+            script.push_back({DiffLine::Missing, (int) (prefix + i), -1});
+        }
+        for (size_t i = 0; i < middleB.size(); i++) {
+            script.push_back({DiffLine::Extra, -1, (int) (prefix + i)});
+        }
+    }
+    for (size_t i = suffix; i > 0; i--) {
+        script.push_back({DiffLine::Same, (int) (a.size() - i), (int) (b.size() - i)});
+    }
+
+    std::vector<DiffHunk> hunks;
+    size_t total = 0;
+    for (size_t i = 0; i < script.size();) {
+        if (script[i].kind == DiffLine::Same) {
+            i++;
+            continue;
+        }
+        // a hunk goes on while the next change is closer than two contexts
+        size_t begin = i >= (size_t) context ? i - context : 0;
+        size_t end = i;
+        size_t same = 0;
+        for (; end < script.size() && same <= (size_t) 2 * context; end++) {
+            same = script[end].kind == DiffLine::Same ? same + 1 : 0;
+        }
+        end -= std::min(same, end - i);
+        end = std::min(script.size(), end + context);
+        total++;
+        if (hunks.size() < maxHunks) {
+            hunks.push_back({std::vector<DiffLine>(script.begin() + begin, script.begin() + end)});
+        }
+        i = end;
+    }
+    if (total == 0 && ignoreWhitespace && expected != actual) {
+        return diffHunks(expected, actual, context, maxHunks, totalHunks, maxEdits, false);
+    }
+    if (totalHunks) {
+        *totalHunks = total;
+    }
+    return hunks;
+}
+
+// "-" lines are expected but missing, "+" lines are printed but not expected, numbered by their line in
+// the expected output or the actual output
+inline std::string formatHunks(const std::vector<DiffHunk> &hunks, const std::vector<std::string> &expected,
+                               const std::vector<std::string> &actual, size_t maxLinesPerHunk = 12, size_t maxLineLength = 200) {
+    auto shorten = [&](const std::string &line) {
+        return line.size() > maxLineLength ? line.substr(0, maxLineLength) + "..." : line;
+    };
+    std::string text;
+    for (const DiffHunk &hunk: hunks) {
+        int firstExpected = -1;
+        int firstActual = -1;
+        for (const DiffLine &line: hunk.lines) {
+            if (firstExpected < 0 && line.expected >= 0) firstExpected = line.expected;
+            if (firstActual < 0 && line.actual >= 0) firstActual = line.actual;
+        }
+        text += "@@ expected line " + std::to_string(firstExpected + 1) + ", your line " + std::to_string(firstActual + 1) + " @@\n";
+        for (size_t i = 0; i < hunk.lines.size() && i < maxLinesPerHunk; i++) {
+            const DiffLine &line = hunk.lines[i];
+            if (line.kind == DiffLine::Same) {
+                text += "  " + std::to_string(line.expected + 1) + ": " + shorten(expected[line.expected]) + "\n";
+            } else if (line.kind == DiffLine::Missing) {
+                text += "- " + std::to_string(line.expected + 1) + ": " + shorten(expected[line.expected]) + "\n";
+            } else {
+                text += "+ " + std::to_string(line.actual + 1) + ": " + shorten(actual[line.actual]) + "\n";
+            }
+        }
+        if (hunk.lines.size() > maxLinesPerHunk) {
+            text += "  ... (" + std::to_string(hunk.lines.size() - maxLinesPerHunk) + " more lines)\n";
+        }
+    }
+    return text;
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include "hashing.hpp"
+
+// The tokens of C++ source without comments and whitespace. Operators are taken longest first, so "a - -b" and
+// "a--b" stay different; the end of a preprocessor line is a token of its own, as it ends a #define.
+inline std::vector<std::string> codeTokens(const std::string &source) {
+    static const std::vector<std::string> operators = {
+        "<<=", ">>=", "...", "->*", "<=>", "::", "->", "++", "--", "<<", ">>", "<=", ">=", "==", "!=", "&&", "||",
+        "+=", "-=", "*=", "/=", "%=", "&=", "|=", "^=", "##", ".*"
+    };
+    std::vector<std::string> tokens;
+    bool lineStart = true;
+    bool directive = false;
+    size_t i = 0;
+    while (i < source.size()) {
+        char c = source[i];
+        if (c == '\n') {
+            if (directive && !(i > 0 && source[i - 1] == '\\')) {
+                tokens.push_back("\n");
+                directive = false;
+            }
+            lineStart = true;
+            i++;
+            continue;
+        }
+        if (std::isspace((unsigned char) c) || (c == '\\' && i + 1 < source.size() && source[i + 1] == '\n')) {
+            i++;
+            continue;
+        }
+        if (source.compare(i, 2, "//") == 0) {
+            i = source.find('\n', i);
+            i = i == std::string::npos ? source.size() : i;
+            continue;
+        }
+        if (source.compare(i, 2, "/*") == 0) {
+            i = source.find("*/", i + 2);
+            i = i == std::string::npos ? source.size() : i + 2;
+            continue;
+        }
+        size_t start = i;
+        if (c == '"' || c == '\'') {
+            for (i++; i < source.size() && source[i] != c && source[i] != '\n'; i++) {
+                if (source[i] == '\\') {
+                    i++;
+                }
+            }
+            i = std::min(i + 1, source.size());
+        } else if (std::isalpha((unsigned char) c) || c == '_') {
+            while (i < source.size() && (std::isalnum((unsigned char) source[i]) || source[i] == '_')) {
+                i++;
+            }
+        } else if (std::isdigit((unsigned char) c)) {
+            while (i < source.size() && (std::isalnum((unsigned char) source[i]) || source[i] == '_' || source[i] == '.' || source[i] == '\'')) {
+                i++;
+            }
+        } else {
+            i++;
+            for (const std::string &op: operators) {
+                if (source.compare(start, op.size(), op) == 0) {
+                    i = start + op.size();
+                    break;
+                }
+            }
+        }
+        if (lineStart && c == '#') {
+            directive = true;
+        }
+        lineStart = false;
+        tokens.push_back(source.substr(start, i - start));
+    }
+    return tokens;
+}
+
+// Hash of the program's tokens, equal for programs differing only in whitespace and comments. With renameIdentifiers
+// the names the program declares (the identifier after a type, "int x", "ll x", "struct x") are replaced by their order
+// of declaration as well, so renamed variables and functions don't make a program new. Names of the library are never
+// renamed, "max" and "min" stay different programs.
+inline uint64_t codeFingerprint(const std::string &source, bool renameIdentifiers = false) {
+    static const std::set<std::string> keywords = {
+        "alignas", "alignof", "and", "asm", "auto", "bool", "break", "case", "catch", "char", "class", "const", "constexpr",
+        "const_cast", "continue", "decltype", "default", "delete", "do", "double", "dynamic_cast", "else", "enum",
+        "explicit", "extern", "false", "float", "for", "friend", "goto", "if", "inline", "int", "long", "mutable",
+        "namespace", "new", "noexcept", "not", "nullptr", "operator", "or", "private", "protected", "public", "register",
+        "reinterpret_cast", "return", "short", "signed", "sizeof", "static", "static_assert", "static_cast", "struct",
+        "switch", "template", "this", "throw", "true", "try", "typedef", "typeid", "typename", "union", "unsigned",
+        "using", "virtual", "void", "volatile", "while", "xor"
+    };
+    // keywords a declared name follows
+    static const std::set<std::string> declaring = {
+        "auto", "bool", "char", "class", "double", "enum", "float", "int", "long", "short", "signed", "struct", "union",
+        "unsigned", "void"
+    };
+    std::vector<std::string> tokens = codeTokens(source);
+    auto isIdentifier = [](const std::string &token) {
+        return !token.empty() && (std::isalpha((unsigned char) token[0]) || token[0] == '_') && !keywords.count(token);
+    };
+
+    std::map<std::string, std::string> renamed;
+    if (renameIdentifiers) {
+        bool directive = false;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            directive = tokens[i] == "#" ? true : tokens[i] == "\n" ? false : directive;
+            if (directive || !isIdentifier(tokens[i]) || tokens[i] == "main" || renamed.count(tokens[i])) {
+                continue;
+            }
+            // "int *x" looks like "n * max", so only a name right after its type counts
+            if (i > 0 && (declaring.count(tokens[i - 1]) || isIdentifier(tokens[i - 1]))) {
+                renamed[tokens[i]] = "\x01" + std::to_string(renamed.size());
+            }
+        }
+    }
+
+    uint64_t hash = fnv1a("");
+    for (size_t i = 0; i < tokens.size(); i++) {
+        bool member = i > 0 && (tokens[i - 1] == "::" || tokens[i - 1] == "." || tokens[i - 1] == "->");
+        auto found = member ? renamed.end() : renamed.find(tokens[i]);
+        hash = fnv1a(found == renamed.end() ? tokens[i] : found->second, hash);
+        hash = fnv1a("\x1f", hash);
+    }
+    return hash;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+#include "llamacpp_client/json.hpp"
+
+// Sampling and length settings shared by the ollama and llama.cpp clients.
+// Unset fields are left out of the request so the server keeps its own default.
+struct GenerationOptions {
+    std::optional<int> maxTokens;
+    std::vector<std::string> stop;
+    std::optional<double> temperature;
+    std::optional<int> topK;
+    std::optional<double> topP;
+    std::optional<int> seed;
+    std::optional<int> threads;
+    std::optional<int> contextSize;
+    // constrain the response to a single C++ code block (llama.cpp grammar, ollama structured output)
+    bool codeOnly = false;
+
+    // fields of a llama.cpp /completion request, threads and context size are fixed when the server starts
+    nlohmann::json toLlamaCpp() const {
+        nlohmann::json fields = nlohmann::json::object();
+        if (maxTokens) fields["n_predict"] = *maxTokens;
+        if (!stop.empty()) fields["stop"] = stop;
+        if (temperature) fields["temperature"] = *temperature;
+        if (topK) fields["top_k"] = *topK;
+        if (topP) fields["top_p"] = *topP;
+        if (seed) fields["seed"] = *seed;
+        return fields;
+    }
+
+    // every field, for keys of recorded and cached responses
+    nlohmann::json toJson() const {
+        nlohmann::json fields = toOllama();
+        fields["code_only"] = codeOnly;
+        return fields;
+    }
+
+    // contents of the "options" object of an ollama /api/generate request
+    nlohmann::json toOllama() const {
+        nlohmann::json fields = nlohmann::json::object();
+        if (maxTokens) fields["num_predict"] = *maxTokens;
+        if (!stop.empty()) fields["stop"] = stop;
+        if (temperature) fields["temperature"] = *temperature;
+        if (topK) fields["top_k"] = *topK;
+        if (topP) fields["top_p"] = *topP;
+        if (seed) fields["seed"] = *seed;
+        if (threads) fields["num_thread"] = *threads;
+        if (contextSize) fields["num_ctx"] = *contextSize;
+        return fields;
+    }
+};
+
+// Decides the options of the next attempt when the previous ones keep failing the same way.
+// Asking again with the same settings tends to produce the same program, so every
+// repeatsBeforeEscalation identical failures the temperature is raised and the seed moved.
+struct EscalationPolicy {
+    int repeatsBeforeEscalation = 2;
+    double temperatureStep = 0.2;
+    double maxTemperature = 1.2;
+    double baseTemperature = 0.8; // used when the base options leave the temperature to the server
+
+    GenerationOptions forAttempt(const GenerationOptions &base, int repeatedFailures) const {
+        int level = repeatsBeforeEscalation > 0 ? repeatedFailures / repeatsBeforeEscalation : 0;
+        if (level == 0) {
+            return base;
+        }
+        GenerationOptions options = base;
+        double temperature = base.temperature.value_or(baseTemperature) + level * temperatureStep;
+        options.temperature = temperature < maxTemperature ? temperature : maxTemperature;
+        if (options.seed) {
+            *options.seed += level;
+        }
+        return options;
+    }
+};
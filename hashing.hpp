@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// 64-bit FNV-1a, stable across runs and builds unlike std::hash, so it can be used for keys stored on disk
+inline uint64_t fnv1a(const std::string &data, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c: data) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+inline std::string toHex(uint64_t value) {
+    char buffer[17];
+    snprintf(buffer, sizeof(buffer), "%016llx", (unsigned long long) value);
+    return buffer;
+}
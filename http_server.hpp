@@ -0,0 +1,168 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+// One request of a client, answered with respond or streamed with writeHeader and write until the connection closes.
+class HttpConnection {
+    int socket;
+
+    bool writeAll(const char *data, size_t size) {
+        while (size > 0) {
+            ssize_t written = send(socket, data, size, MSG_NOSIGNAL);
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            size -= written;
+        }
+        return true;
+    }
+
+public:
+    std::string method;
+    std::string path;
+    std::string body;
+
+    explicit HttpConnection(int socket) : socket(socket) {
+        int one = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    HttpConnection(const HttpConnection &) = delete;
+    HttpConnection &operator=(const HttpConnection &) = delete;
+
+    ~HttpConnection() {
+        close(socket);
+    }
+
+    bool readRequest(size_t maxBodyBytes) {
+        std::string data;
+        char buffer[65536];
+        size_t headerEnd;
+        while ((headerEnd = data.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+            if (received <= 0 || data.size() > 65536) {
+                return false;
+            }
+            data.append(buffer, received);
+        }
+        std::string requestLine = data.substr(0, data.find("\r\n"));
+        size_t firstSpace = requestLine.find(' ');
+        size_t secondSpace = requestLine.find(' ', firstSpace + 1);
+        if (firstSpace == std::string::npos || secondSpace == std::string::npos) {
+            return false;
+        }
+        method = requestLine.substr(0, firstSpace);
+        path = requestLine.substr(firstSpace + 1, secondSpace - firstSpace - 1);
+
+        size_t contentLength = 0;
+        std::string headers = data.substr(0, headerEnd);
+        for (char &c: headers) c = tolower(c);
+        size_t lengthHeader = headers.find("content-length:");
+        if (lengthHeader != std::string::npos) {
+            contentLength = strtoul(headers.c_str() + lengthHeader + 15, nullptr, 10);
+        }
+        if (contentLength > maxBodyBytes) {
+            return false;
+        }
+        body = data.substr(headerEnd + 4);
+        while (body.size() < contentLength) {
+            ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                return false;
+            }
+            body.append(buffer, received);
+        }
+        return true;
+    }
+
+    // the body is streamed after this until the connection is closed
+    bool writeHeader(int status, const std::string &contentType) {
+        std::string reason = status == 200 ? "OK" : status == 202 ? "Accepted" : status == 404 ? "Not Found" :
+                             status == 409 ? "Conflict" : "Bad Request";
+        std::string header = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n"
+                             "Content-Type: " + contentType + "\r\n"
+                             "Connection: close\r\n\r\n";
+        return writeAll(header.data(), header.size());
+    }
+
+    // true once the client closed the connection, doesn't wait
+    bool closed() {
+        char byte;
+        ssize_t received = recv(socket, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        return received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR);
+    }
+
+    // false once the client went away
+    bool write(const std::string &data) {
+        return writeAll(data.data(), data.size());
+    }
+
+    void respond(int status, const std::string &contentType, const std::string &body) {
+        if (writeHeader(status, contentType)) {
+            write(body);
+        }
+    }
+};
+
+// A small HTTP/1.1 server on the loopback interface, every connection is served by a thread of its own with a
+// single request.
+class HttpServer {
+public:
+    using Handler = std::function<void(HttpConnection &)>;
+
+private:
+    Handler handler;
+    size_t maxBodyBytes;
+    int server = -1;
+
+public:
+    HttpServer(Handler handler, size_t maxBodyBytes = 64 << 20) : handler(std::move(handler)), maxBodyBytes(maxBodyBytes) {}
+
+    ~HttpServer() {
+        if (server >= 0) {
+            close(server);
+        }
+    }
+
+    // only local clients can connect, there is no authentication
+    bool listen(int port, std::string &error) {
+        server = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        if (server < 0 || bind(server, (sockaddr *) &address, sizeof(address)) < 0 || ::listen(server, 128) < 0) {
+            error = "couldn't listen on port " + std::to_string(port) + ": " + strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    void run() {
+        while (true) {
+            int client = accept(server, nullptr, nullptr);
+            if (client < 0) {
+                continue;
+            }
+            std::thread([this, client] {
+                HttpConnection connection(client);
+                if (connection.readRequest(maxBodyBytes)) {
+                    handler(connection);
+                }
+            }).detach();
+        }
+    }
+};
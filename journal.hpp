@@ -0,0 +1,144 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "llamacpp_client/json.hpp"
+
+// An append-only JSON lines file recording one problem's session (prompts, responses, verdicts, timings), read back
+// to resume it. Every line is a single write(), so a crash of the process loses nothing written; the file is synced
+// to disk every syncEvery lines or syncSeconds, whichever comes first, so a power loss costs at most that much. A
+// thread syncs what is left unsynced after syncSeconds even when nothing else is appended.
+class SessionJournal {
+    std::mutex mutex;
+    int fd = -1;
+    int syncEvery;
+    double syncSeconds;
+    int unsynced = 0;
+    std::chrono::steady_clock::time_point lastSync = std::chrono::steady_clock::now();
+
+    std::condition_variable stopped;
+    bool stopping = false;
+    std::thread syncer;
+
+    void syncLocked() {
+        if (fd >= 0 && unsynced > 0) {
+            fdatasync(fd);
+        }
+        unsynced = 0;
+        lastSync = std::chrono::steady_clock::now();
+    }
+
+    void syncPeriodically() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopped.wait_for(lock, std::chrono::duration<double>(syncSeconds), [this] { return stopping; })) {
+            if (std::chrono::duration<double>(std::chrono::steady_clock::now() - lastSync).count() >= syncSeconds) {
+                syncLocked();
+            }
+        }
+    }
+
+public:
+    explicit SessionJournal(int syncEvery = 16, double syncSeconds = 1) : syncEvery(syncEvery), syncSeconds(syncSeconds) {}
+
+    SessionJournal(const SessionJournal &) = delete;
+    SessionJournal &operator=(const SessionJournal &) = delete;
+
+    ~SessionJournal() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        stopped.notify_all();
+        if (syncer.joinable()) {
+            syncer.join();
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        syncLocked();
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    bool open(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return false;
+        }
+        // a line torn by a power loss is ended, so the next one starts on a line of its own
+        struct stat info;
+        char last = '\n';
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            int reader = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (reader >= 0) {
+                if (pread(reader, &last, 1, info.st_size - 1) != 1) {
+                    last = '\n';
+                }
+                close(reader);
+            }
+        }
+        if (last != '\n' && write(fd, "\n", 1) != 1) {
+            return false;
+        }
+        if (syncSeconds > 0 && !syncer.joinable()) {
+            syncer = std::thread(&SessionJournal::syncPeriodically, this);
+        }
+        return true;
+    }
+
+    bool isOpen() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return fd >= 0;
+    }
+
+    void append(const nlohmann::json &entry) {
+        std::string line = entry.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) + '\n';
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0) {
+            return;
+        }
+        for (size_t written = 0; written < line.size();) {
+            ssize_t result = write(fd, line.data() + written, line.size() - written);
+            if (result <= 0) {
+                return;
+            }
+            written += result;
+        }
+        unsynced++;
+        if (unsynced >= syncEvery || std::chrono::duration<double>(std::chrono::steady_clock::now() - lastSync).count() >= syncSeconds) {
+            syncLocked();
+        }
+    }
+
+    // forces what was appended to the disk, e.g. once a problem is solved
+    void sync() {
+        std::lock_guard<std::mutex> lock(mutex);
+        syncLocked();
+    }
+
+    // the entries of the last session in the file (from its last "start" entry), torn lines are skipped
+    static std::vector<nlohmann::json> lastSession(const std::string &path) {
+        std::vector<nlohmann::json> entries;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line)) {
+            nlohmann::json entry = nlohmann::json::parse(line, nullptr, false);
+            if (!entry.is_object()) {
+                continue;
+            }
+            if (entry.value("type", "") == "start") {
+                entries.clear();
+            }
+            entries.push_back(std::move(entry));
+        }
+        return entries;
+    }
+};
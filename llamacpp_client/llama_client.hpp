@@ -0,0 +1,297 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <curl/curl.h>
+#include "json.hpp"
+#include "../generation_options.hpp"
+
+struct PromptTimings {
+    int tokensEvaluated = 0; // prompt tokens the server had to account for
+    int tokensCached = 0;    // prompt tokens reused from the slot's KV cache
+    int promptN = 0;         // prompt tokens actually evaluated in this request
+    double promptMs = 0;
+    int predictedN = 0;
+    double predictedMs = 0;
+    // measured by the client
+    double ttftMs = 0;  // request sent until the first generated text arrived
+    double totalMs = 0;
+};
+
+class LLamaClient {
+    std::string hostAddress;
+    std::string content;
+    // received part of an event whose line hasn't ended yet
+    std::string pending;
+    PromptTimings timings;
+    std::atomic<bool> cancelled = false;
+    bool failed = false;
+    // the HTTP status of the last prompt, or the code of an error event in its stream
+    long status = 0;
+    std::chrono::steady_clock::time_point requestStart;
+
+    // picks up the stats the server attaches to the final ("stop": true) event
+    void readTimings(const nlohmann::json &event) {
+        timings.tokensEvaluated = event.value("tokens_evaluated", 0);
+        if (event.contains("timings")) {
+            const nlohmann::json &t = event["timings"];
+            timings.promptN = t.value("prompt_n", 0);
+            timings.promptMs = t.value("prompt_ms", 0.0);
+            timings.predictedN = t.value("predicted_n", 0);
+            timings.predictedMs = t.value("predicted_ms", 0.0);
+            // older servers don't report cache_n, everything evaluated but not processed came from the cache
+            timings.tokensCached = t.value("cache_n", timings.tokensEvaluated - timings.promptN);
+        }
+    }
+
+    // handles one "data: {...}" line of the server-sent event stream
+    void handleEvent(const std::string &line) {
+        if (line.rfind("data:", 0) != 0) {
+            return;
+        }
+        // the space after the field name is optional
+        size_t start = line.size() > 5 && line[5] == ' ' ? 6 : 5;
+        nlohmann::json res = nlohmann::json::parse(line.begin() + start, line.end(), nullptr, false);
+        if (!res.is_object()) {
+            return;
+        }
+        // errors during the generation (e.g. the context is full) arrive as an event of their own
+        if (res.contains("error")) {
+            std::cerr << "server error: " << res["error"].dump() << std::endl;
+            failed = true;
+            status = res["error"].is_object() ? res["error"].value("code", 500L) : 500;
+            return;
+        }
+        std::string response = res.value("content", "");
+        if (content.empty() && !response.empty()) {
+            timings.ttftMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requestStart).count();
+        }
+        content += response;
+        if (onContent) {
+            onContent(response);
+        } else {
+            std::cout << response;
+            fflush(stdout);
+        }
+        if (res.value("stop", false)) {
+            readTimings(res);
+        }
+    }
+
+    static size_t writeCallback(char *data, size_t size, size_t nmemb, LLamaClient *client) {
+        // returning less than was received makes curl abort the transfer
+        if (client->cancelled) {
+            return 0;
+        }
+        // curl hands over whatever arrived, that can be several events or a part of one, so only complete lines are parsed
+        client->pending.append(data, size * nmemb);
+        size_t lineStart = 0;
+        size_t lineEnd;
+        while ((lineEnd = client->pending.find('\n', lineStart)) != std::string::npos) {
+            size_t length = lineEnd - lineStart;
+            if (length > 0 && client->pending[lineEnd - 1] == '\r') {
+                length--;
+            }
+            client->handleEvent(client->pending.substr(lineStart, length));
+            lineStart = lineEnd + 1;
+        }
+        client->pending.erase(0, lineStart);
+        return client->cancelled ? 0 : size * nmemb;
+    }
+
+    // kept until the request is done, curl reads the body from it
+    std::string requestBody;
+
+    const std::string &buildRequest(std::string promptText, const GenerationOptions &options, int slot) {
+        nlohmann::json request = options.toLlamaCpp();
+        request["prompt"] = std::move(promptText);
+        request["cache_prompt"] = cachePrompt;
+        request["id_slot"] = slot;
+        if (!grammar.empty()) {
+            request["grammar"] = grammar;
+        }
+        request["stream"] = true;
+
+        // compile logs and program output are not always valid UTF-8, broken sequences are replaced instead of failing
+        // the request
+        requestBody = request.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+        return requestBody;
+    }
+
+    // plain (non streamed) request, used for the slot management, tokenize and health endpoints
+    bool send(const std::string &path, const std::string *body, std::string *response = nullptr) {
+        CURL *curl = curl_easy_init();
+        if (!curl) {
+            std::cerr << "CURL initialization failed" << std::endl;
+            return false;
+        }
+
+        std::string url = "http://" + hostAddress + path;
+        std::string sink;
+        struct curl_slist *headers = nullptr;
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        if (body) {
+            curl_easy_setopt(curl, CURLOPT_POST, 1L);
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->c_str());
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, +[](char *data, size_t size, size_t nmemb, std::string *out) {
+            out->append(data, size * nmemb);
+            return size * nmemb;
+        });
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, response ? response : &sink);
+
+        CURLcode res = curl_easy_perform(curl);
+        long status = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+        if (res != CURLE_OK) {
+            std::cerr << "CURL request failed: " << curl_easy_strerror(res) << std::endl;
+        }
+
+        curl_easy_cleanup(curl);
+        curl_slist_free_all(headers);
+        return res == CURLE_OK && status == 200;
+    }
+
+    bool post(const std::string &path, const std::string &body, std::string *response = nullptr) {
+        return send(path, &body, response);
+    }
+
+public:
+    // keep the evaluated prompt in the slot's KV cache so requests sharing a prefix only evaluate the new suffix
+    bool cachePrompt = true;
+    // number of parallel slots the server was started with (-np), used to spread problems over slots
+    int slotCount = 1;
+    // GBNF grammar the response has to match, empty means unconstrained
+    std::string grammar;
+    // receives the generated text piece by piece, printed to stdout when not set
+    std::function<void(const std::string &)> onContent;
+
+    // exactly one fenced C++ block and nothing else, once the closing fence is produced the only
+    // continuation the grammar allows is the end of the generation
+    inline static const std::string cppCodeBlockGrammar =
+        "root ::= \"```cpp\\n\" code \"\\n```\"\n"
+        "code ::= ([^`] | \"`\" [^`] | \"``\" [^`])*\n";
+
+    LLamaClient(std::string hostAddress="127.0.0.1:8080") : hostAddress(hostAddress) {}
+
+    // every prompt for the same problem starts with the same instructions and statement, so keep them on one slot
+    int slotFor(const std::string &problemKey) const {
+        return std::hash<std::string>{}(problemKey) % slotCount;
+    }
+
+    // requires the server to be started with --slot-save-path, filename is relative to it
+    bool saveSlot(int slot, const std::string &filename) {
+        return post("/slots/" + std::to_string(slot) + "?action=save", nlohmann::json{{"filename", filename}}.dump());
+    }
+
+    bool restoreSlot(int slot, const std::string &filename) {
+        return post("/slots/" + std::to_string(slot) + "?action=restore", nlohmann::json{{"filename", filename}}.dump());
+    }
+
+    std::vector<int> tokenize(const std::string &text) {
+        std::string response;
+        if (!post("/tokenize", nlohmann::json{{"content", text}}.dump(), &response)) {
+            return {};
+        }
+        nlohmann::json parsed = nlohmann::json::parse(response, nullptr, false);
+        if (!parsed.is_object() || !parsed.contains("tokens")) {
+            return {};
+        }
+        return parsed["tokens"].get<std::vector<int>>();
+    }
+
+    // the server answers 503 while the model is still loading
+    bool healthy() {
+        return send("/health", nullptr);
+    }
+
+    // stops the request running in another thread, prompt returns what was generated until then
+    void cancel() {
+        cancelled = true;
+    }
+
+    const PromptTimings &lastTimings() const {
+        return timings;
+    }
+
+    // 0 when the last prompt got no answer at all (no connection, cancelled before the headers)
+    long lastStatus() const {
+        return status;
+    }
+
+    void printTimings() const {
+        std::cout << "prompt tokens: " << timings.tokensEvaluated
+                  << " (cached " << timings.tokensCached << ", evaluated " << timings.promptN
+                  << " in " << timings.promptMs << " ms), generated " << timings.predictedN
+                  << " tokens in " << timings.predictedMs << " ms, first token after " << timings.ttftMs
+                  << " ms, " << timings.totalMs << " ms in total" << std::endl;
+    }
+
+    // returns the generated text, ok is set to false when the request failed or was cancelled
+    std::string prompt(std::string promptText, const GenerationOptions &options = GenerationOptions(), int slot = -1,
+                       bool *ok = nullptr) {
+        CURL *curl;
+        CURLcode res;
+        curl = curl_easy_init();
+
+        if (!curl) {
+            std::cerr << "CURL initialization failed" << std::endl;
+            if (ok) *ok = false;
+            return "";
+        }
+
+        std::string url = "http://" + hostAddress + "/completion";
+        const std::string &jsonPayload = buildRequest(std::move(promptText), options, slot);
+
+        content.clear();
+        pending.clear();
+        timings = PromptTimings();
+        cancelled = false;
+        failed = false;
+        status = 0;
+        requestStart = std::chrono::steady_clock::now();
+
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, jsonPayload.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
+        // called at least once a second while nothing arrives (prompt evaluation, a buffering proxy), so a cancel
+        // doesn't wait for the next event
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, +[](LLamaClient *client, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+            return client->cancelled ? 1 : 0;
+        });
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
+
+        struct curl_slist *headers = nullptr;
+        headers = curl_slist_append(headers, "Content-Type: application/json");
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        res = curl_easy_perform(curl);
+        timings.totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - requestStart).count();
+        if (res != CURLE_OK && !cancelled) {
+            std::cerr << "CURL request failed: " << curl_easy_strerror(res) << std::endl;
+        }
+        long httpStatus = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &httpStatus);
+        if (httpStatus != 200 && res == CURLE_OK) {
+            std::cerr << "server answered " << httpStatus << ": " << pending << std::endl;
+        }
+        if (!failed) {
+            status = httpStatus;
+        }
+        if (ok) *ok = res == CURLE_OK && httpStatus == 200 && !failed;
+
+        curl_easy_cleanup(curl);
+        curl_slist_free_all(headers);
+
+        return content;
+    }
+};
@@ -3,23 +3,157 @@
 #include <string>
 #include <filesystem>
 #include <cstdlib>
+#include <cmath>
 #include <set>
+#include <map>
+#include <tuple>
 #include <optional>
-#include "ollama.hpp"
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <iomanip>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#include <future>
+#include <memory>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "backend.hpp"
+#include "backend_pool.hpp"
+#include "metrics.hpp"
+#include "replay.hpp"
+#include "response_cache.hpp"
+#include "cascade.hpp"
+#include "prompt_builder.hpp"
+#include "diff.hpp"
+#include "minimizer.hpp"
+#include "stress.hpp"
+#include "concurrency.hpp"
+#include "workspace.hpp"
+#include "config.hpp"
+#include "budget.hpp"
+#include "journal.hpp"
+#include "fingerprint.hpp"
+#include "http_server.hpp"
 
 namespace fs = std::filesystem;
 
 
 int verbose = 2;
 
+// where the solution passing all tests is written, every attempt works in a workspace of its own until then
 std::string pathToSolution = "solution.cpp";
-std::string compileErrorsPath = "compileErrors.txt";
 std::string pathToCompiledSolution = "solution";
-std::string pathToDiffOutput = "diffOutput.txt";
-std::string pathToSatoriGPTOutput = "SatoriGPTOutput.out";
+// workspaces are created here, empty for /dev/shm when it allows executing programs and the temp directory otherwise
+std::string workspaceRoot = "";
+// leaves the workspaces behind for debugging
+bool keepWorkspaces = false;
 std::string usedModel = "codellama";
+// models tried in turn, e.g. {{"codellama:7b", 3}, {"codellama:13b", 5}, {"codellama:34b", 0}}, empty uses only usedModel
+std::vector<CascadeStep> modelCascade = {};
+// the same failure this many times in a row moves the cascade to the next model before its attempts are used up
+int cascadeRepeatsBeforeEscalation = 3;
+// "ollama" or "llamacpp", can be given as the first argument, the server address as the second
+// "replay" (or "replay-fast" to skip the recorded delays) serves the responses recorded in the file given as the address
+std::string backendKind = "ollama";
+// empty means the backend's default address, several comma separated addresses spread the requests over all of them
+std::string backendUrl = "";
+std::unique_ptr<BackendPool> backendPool;
+BackendPool::Settings backendPoolSettings;
+// every response of the model is recorded to this file when set, for replaying the run without a model
+std::string recordPath = "";
+RecordingStore recordings;
+// responses to deterministic requests (fixed seed or temperature 0) are cached in this directory when set
+std::string responseCacheDir = "";
+uintmax_t responseCacheBytes = 256 << 20;
+std::unique_ptr<ResponseCache> responseCache;
+// parallel slots of the llama.cpp server (-np)
+int llamaSlots = 1;
 std::string problemPath = "problem.txt";
 std::string testsDir = "./tests";
+// {source} and {binary} are replaced with the paths, the errors are read from stderr
+std::string compileCommand = "g++ {source} -o {binary}";
+// limits of a problem (rounds, seconds, generated tokens, CPU seconds of the test runs, 0 for no limit), once one is
+// reached the candidate passing the most tests is kept. The user is asked for tips every tipsEvery rounds (0 for never)
+Budget budget;
+int tipsEvery = 5;
+// stops testing a candidate at its first failing test, without it all tests run to know how many pass
+bool failFast = false;
+// every problem's session (prompts, responses, verdicts, timings) is appended to this file next to its solution, empty
+// for none; resumeSession continues the last session in it without asking the model again for what it already answered
+std::string journalName = "session.jsonl";
+bool resumeSession = false;
+// the llama.cpp slots of a problem's candidates are saved after every round and restored when its session is resumed,
+// so a restarted server doesn't evaluate the prompts again; needs a server started with --slot-save-path
+bool saveSlots = false;
+// the model giving no answer (the server is down, nothing was recorded for the prompt) this many rounds in a row gives
+// the problem up (0 never does), before that the round is asked again after a pause growing up to 30 s
+int maxFailedGenerations = 3;
+// the best this many candidates of a problem are kept with their workspaces
+int keptCandidates = 3;
+// a candidate with the same tokens as an earlier one of its problem (whitespace and comments aside, with
+// fingerprintRenaming also the names it declares) isn't compiled and tested again, it gets the earlier verdict
+bool deduplicateCandidates = true;
+bool fingerprintRenaming = false;
+// never reads stdin and doesn't stream the generated code, for runs without a terminal
+bool nonInteractive = false;
+// a runaway generation is cut off after maxTokens instead of streaming for minutes
+GenerationOptions generationOptions = [] {
+    GenerationOptions options;
+    options.maxTokens = 2048;
+    // the prompts are shortened to fit into contextSize - maxTokens, keep it equal to the server's context (-c for llama.cpp)
+    options.contextSize = 4096;
+    // set to make the server output nothing but the code, so nothing has to be stripped afterwards
+    options.codeOnly = false;
+    return options;
+}();
+EscalationPolicy escalationPolicy;
+// every LLM call is also appended to this file as a JSON line when set
+std::string latencyLogPath = "";
+LatencyLog latencyLog;
+// best-of-N: how many candidates are generated, compiled and tested concurrently for every prompt
+int candidatesPerRound = 1;
+// candidate i of a round samples with temperature raised by i * candidateTemperatureSpread
+double candidateTemperatureSpread = 0.1;
+// how many places where the output differs are shown to the model, the input of a failed test is shown when it is this small
+size_t maxDiffHunks = 3;
+uintmax_t maxDiffInputBytes = 1024;
+// outputs differing in more lines are shown as replaced instead of searched for the differences
+int maxDiffEdits = 300;
+// a failing test bigger than maxDiffInputBytes is shrunk with delta debugging when a reference solution is given,
+// its output on the smaller inputs is the expected one; inputValidator (reads the input on stdin, exits with 0
+// when it is valid) keeps the shrinking to inputs of the problem's format
+std::string referenceSolution = "";
+std::string inputValidator = "";
+// limits of the shrinking: seconds for a single run (also of a stress test) and runs in total
+int checkTimeLimit = 2;
+int minimizeMaxTests = 2000;
+// stress mode: after the tests pass, stressTests inputs from the generator (called with the seed as its only argument,
+// prints a test) are compared with referenceSolution, a failing one is added to the tests and fed back to the model
+std::string stressGenerator = "";
+int stressTests = 1000;
+// failing stress tests kept in a tests directory, the oldest one is removed for a new one
+int maxStressTestsKept = 20;
+// batch mode: every directory in batchDir with a problem.txt and a tests directory is solved, batchProblemsAtOnce
+// of them concurrently (0 for as many as LLM slots and CPU workers together), every one gets at most batchMaxTries rounds
+// unless --max-tries is given
+std::string batchDir = "";
+int batchProblemsAtOnce = 0;
+int batchMaxTries = 20;
+// generations running at once (0 for llamaSlots) and compilations or test runs at once (0 for all cores) in batch mode
+// and server mode
+int batchLlmSlots = 0;
+int batchCpuWorkers = 0;
+// server mode: problems submitted over HTTP to 127.0.0.1:serverPort (0 for no server) are solved in directories of
+// their own in serverDir, batchProblemsAtOnce of them at once
+int serverPort = 0;
+std::string serverDir = "jobs";
+std::unique_ptr<Semaphore> cpuWorkerPool;
 
 const std::string bold = "\033[1m";
 const std::string red = "\033[31m";
@@ -42,7 +176,7 @@ std::string getUsersPathToTestDir() {
     return testsDir;
 }
 
-std::string getUsersProblemDescription() {
+std::string getUsersProblemDescription(std::string problemPath = ::problemPath) {
     // std::cout<<"type in path of the problem description:\n";
     // std::string filePath;
     // std::getline(std::cin, filePath);
@@ -63,34 +197,49 @@ std::string getUsersProblemDescription() {
     return fileContents;
 }
 
-std::string createDiffPrompt(std::string pathToSatoriGPTOutput, std::string failingTest) {
-    std::string prompt;
-    std::string ifstream;
-    std::string line;
-    std::ifstream outputFile(pathToSatoriGPTOutput);
-
-    // std::cout << "satoriGPTOutput: " << pathToSatoriGPTOutput << std::endl;
-    // std::cout << "failingTest: " << failingTest << std::endl;
-
-    if(outputFile) {
-        prompt += "your answear: ";
-        while (std::getline(outputFile, line)) {
-            prompt += line + '\n';
+std::string getStringWithFileContents(std::string path) {
+    std::string solutionString;
+    std::ifstream solutionFile(path);
+    if (solutionFile) {
+        std::string line;
+        while (std::getline(solutionFile, line)) {
+            solutionString += line + '\n';
         }
+        solutionFile.close();
     }
-    else
+    return solutionString;
+}
+
+// only the first places where the output differs, the outputs themselves can be megabytes
+std::string createDiffPrompt(std::string pathToSatoriGPTOutput, std::string failingTest, std::string pathToTestDir = getUsersPathToTestDir()) {
+    std::string pathToTest = pathToTestDir + "/" + failingTest.substr(0, failingTest.size() - 2);
+    if (!fs::exists(pathToSatoriGPTOutput) || !fs::exists(pathToTest + "out")) {
         return "";
+    }
+    std::vector<std::string> actual = readLines(pathToSatoriGPTOutput);
+    std::vector<std::string> expected = readLines(pathToTest + "out");
 
-    std::ifstream expectedOutputFile(getUsersPathToTestDir() + "/" + failingTest.substr(0, failingTest.size()-2) + "out");
-    // std::cout << "expectedOutputFile: " << getUsersPathToTestDir() + failingTest.substr(0, failingTest.size()-2) + "out" << std::endl;
-    if(expectedOutputFile) {
-        prompt += "expected answear: ";
-        while (std::getline(expectedOutputFile, line)) {
-            prompt += line + '\n';
-        }
+    std::string prompt = "test " + failingTest + " failed. ";
+    std::error_code error;
+    uintmax_t inputSize = fs::file_size(pathToTest + "in", error);
+    if (!error && inputSize <= maxDiffInputBytes) {
+        prompt += "Its input:\n" + getStringWithFileContents(pathToTest + "in") + "\n";
+    }
+    if (actual.empty()) {
+        prompt += "Your program printed nothing, " + std::to_string(expected.size()) + " lines were expected.\n";
+        return prompt;
+    }
+    size_t totalHunks = 0;
+    std::vector<DiffHunk> hunks = diffHunks(expected, actual, 1, maxDiffHunks, &totalHunks, maxDiffEdits);
+    if (hunks.empty()) {
+        prompt += "Your output has the expected lines, but differs in whitespace (e.g. the newline at the end of the output).\n";
+        return prompt;
+    }
+    prompt += "Differences to the expected output, lines with - are expected but missing in your answer, lines with + "
+              "are in your answer but not expected:\n" + formatHunks(hunks, expected, actual);
+    if (totalHunks > hunks.size()) {
+        prompt += "... and " + std::to_string(totalHunks - hunks.size()) + " more differences\n";
     }
-    else
-        return "";
     return prompt;
 }
 
@@ -114,6 +263,11 @@ enum TestStatus {
 struct TestResult {
     TestStatus status;
     std::optional<std::string> failingTest;
+    // tests run and passed (all of them unless failFast), CPU time and peak memory the solution used on them
+    int passed = 0;
+    int total = 0;
+    double cpuSeconds = 0;
+    long maxMemoryKb = 0;
 
     TestResult(TestStatus s, std::optional<std::string> test = std::nullopt)
             : status(s), failingTest(test) {}
@@ -123,43 +277,134 @@ enum CompilationResult {
     CompilationSuccess, CompilationFailed
 };
 
+bool isReplay() {
+    return backendKind == "replay" || backendKind == "replay-fast";
+}
+
+std::unique_ptr<LLMBackend> createBackend() {
+    if (isReplay()) {
+        return std::make_unique<ReplayBackend>(recordings, backendKind == "replay");
+    }
+    std::unique_ptr<LLMBackend> backend = backendPool ? std::make_unique<PooledBackend>(*backendPool) : makeBackend(backendKind, backendUrl, llamaSlots);
+    if (backend && responseCache) {
+        backend = std::make_unique<CachingBackend>(std::move(backend), *responseCache);
+    }
+    // outside the cache, so answers from the cache are recorded too and a recording replays the whole run
+    if (backend && !recordPath.empty()) {
+        backend = std::make_unique<RecordingBackend>(std::move(backend), recordings);
+    }
+    return backend;
+}
+
+// connections of finished generations, the next candidate takes one of them instead of connecting again
+std::mutex idleBackendsMutex;
+std::vector<std::unique_ptr<LLMBackend>> idleBackends;
+
+std::unique_ptr<LLMBackend> acquireBackend() {
+    {
+        std::lock_guard<std::mutex> lock(idleBackendsMutex);
+        if (!idleBackends.empty()) {
+            std::unique_ptr<LLMBackend> backend = std::move(idleBackends.back());
+            idleBackends.pop_back();
+            return backend;
+        }
+    }
+    return createBackend();
+}
+
+void releaseBackend(std::unique_ptr<LLMBackend> backend) {
+    if (backend) {
+        std::lock_guard<std::mutex> lock(idleBackendsMutex);
+        idleBackends.push_back(std::move(backend));
+    }
+}
+
 class Assistant {
 
     std::string model;
-    ollama::response context;
+    // every assistant has its own connection, so concurrent candidates don't queue behind each other
+    std::unique_ptr<LLMBackend> backend;
     std::ofstream solutionFile;
 
-    std::function<void(const ollama::response&)> printPartialResponse = [this](const ollama::response &response ) {
+    std::chrono::steady_clock::time_point promptStart;
+    std::chrono::steady_clock::time_point firstToken;
+    int receivedPieces = 0;
+
+    LLMBackend::TokenCallback printPartialResponse = [this](const std::string &response) {
+        if (cancelled && cancelled->load()) {
+            backend->cancel();
+            return;
+        }
+        if (receivedPieces++ == 0) {
+            firstToken = std::chrono::steady_clock::now();
+        }
         if (verbose) {
-            LOG(response.as_simple_string());
+            LOG(response);
             fflush(stdout);
         }
-        solutionFile << response.as_simple_string();
+        solutionFile << response;
     };
 
 public:
     int verbose = 2;
     std::string solution_path;
+    // when set the running generation is dropped and prompt returns false
+    const std::atomic<bool> *cancelled = nullptr;
+    // tokens of the last answer, counted against the problem's budget
+    int generatedTokens = 0;
 
     Assistant(std::string solution_path = pathToSolution,
-              std::string model = usedModel) : solution_path(solution_path), model(model) {
+              std::string model = usedModel) : model(model), backend(acquireBackend()),
+                                               solution_path(solution_path) {
         // solutionFile.open(solution_path);
     }
 
-    void reset_context() {
-        context = ollama::response();
+    LLMBackend &server() {
+        return *backend;
     }
 
-    void prompt(std::string prompt, bool add_context = true) {
+    // stage names the kind of prompt in the latency summary
+    bool prompt(std::string prompt, const GenerationOptions &options = generationOptions, const std::string &stage = "prompt") {
+        if (cancelled && cancelled->load()) {
+            return false;
+        }
         solutionFile.open(solution_path);
-        reset_context();
-        ollama::generate(model, prompt, context, printPartialResponse);
+        receivedPieces = 0;
+        promptStart = std::chrono::steady_clock::now();
+        bool finished = backend->generate(model, prompt, options, printPartialResponse);
+        auto end = std::chrono::steady_clock::now();
         solutionFile.flush();
         solutionFile.close();
+
+        auto ms = [](auto duration) { return std::chrono::duration<double, std::milli>(duration).count(); };
+        GenerationStats stats = backend->lastStats();
+        CallRecord record;
+        record.stage = stage;
+        record.backend = backend->name();
+        record.endpoint = backend->endpoint();
+        record.model = model;
+        record.finished = finished;
+        record.ttftMs = ms((receivedPieces ? firstToken : end) - promptStart);
+        record.totalMs = ms(end - promptStart);
+        record.promptTokens = stats.promptTokens;
+        record.cachedPromptTokens = stats.cachedPromptTokens;
+        // streamed pieces are single tokens for both servers, good enough when the server doesn't count
+        record.generatedTokens = stats.generatedTokens ? stats.generatedTokens : receivedPieces;
+        generatedTokens = record.generatedTokens;
+        record.serverPromptMs = stats.promptMs;
+        record.serverGenerationMs = stats.generationMs;
+        latencyLog.add(record);
+
+        LOG("\n[" + backend->name() + (record.endpoint.empty() ? "" : "@" + record.endpoint) + "] first token after " + std::to_string((int) record.ttftMs) + " ms, prompt: " +
+            std::to_string(stats.promptTokens) + " tokens (" + std::to_string(stats.cachedPromptTokens) + " cached), generated " +
+            std::to_string(record.generatedTokens) + " tokens in " + std::to_string((int) record.totalMs) + " ms (" +
+            std::to_string((int) record.tokensPerSecond()) + " tokens/s)\n");
+        return finished;
     }
 
     ~Assistant() {
         // solutionFile.close();
+        releaseBackend(std::move(backend));
     }
 };
 
@@ -167,7 +412,78 @@ std::string changeExtension(std::string path, int extensionLength, std::string n
     return path.substr(0, path.size() - extensionLength) + newExtension;
 }
 
-CompilationResult compileSolution(std::string pathToSolution, std::string compileErrorsPath, std::string pathToCompiledSolution) {
+// the path of a program as the shell runs it, ./ is needed for one in the working directory
+std::string executable(const std::string &path) {
+    return fs::path(path).is_absolute() ? path : "./" + path;
+}
+
+// what commands used, the CPU time summed over all of them and the memory of the biggest one
+struct RunUsage {
+    double cpuSeconds = 0;
+    long maxMemoryKb = 0;
+};
+
+// runs command with the shell like system(), but kills it (and everything it started) once cancelled is set
+// returns the exit status, or -1 if the command was cancelled; what it used is added to usage
+// every process it starts is killed after cpuSecondsLimit CPU seconds (rounded up), 0 for no limit
+int runCommand(const std::string &command, const std::atomic<bool> *cancelled = nullptr, RunUsage *usage = nullptr,
+               double cpuSecondsLimit = 0) {
+    if (!cancelled && !usage && cpuSecondsLimit <= 0) {
+        return system(command.c_str());
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        if (cpuSecondsLimit > 0) {
+            // SIGXCPU at the limit, SIGKILL a second later for a program that handles it
+            rlim_t seconds = std::ceil(cpuSecondsLimit);
+            struct rlimit limit = {seconds, seconds + 1};
+            setrlimit(RLIMIT_CPU, &limit);
+        }
+        execl("/bin/sh", "sh", "-c", command.c_str(), (char *) nullptr);
+        _exit(127);
+    }
+    setpgid(pid, pid);
+
+    // most test runs take a few milliseconds, so poll often at first and back off for the long ones
+    auto pollInterval = std::chrono::microseconds(100);
+    int status;
+    while (true) {
+        struct rusage used;
+        pid_t result = wait4(pid, &status, WNOHANG, &used);
+        if (result == pid) {
+            if (usage) {
+                // the shell waits for what it started, so this includes the command itself
+                usage->cpuSeconds += used.ru_utime.tv_sec + used.ru_stime.tv_sec + (used.ru_utime.tv_usec + used.ru_stime.tv_usec) / 1e6;
+                usage->maxMemoryKb = std::max(usage->maxMemoryKb, used.ru_maxrss);
+            }
+            return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        }
+        if (result < 0) {
+            return -1;
+        }
+        if (cancelled && cancelled->load()) {
+            kill(-pid, SIGKILL);
+            waitpid(pid, &status, 0);
+            return -1;
+        }
+        std::this_thread::sleep_for(pollInterval);
+        pollInterval = std::min(pollInterval * 2, std::chrono::microseconds(5000));
+    }
+}
+
+std::string replaceAll(std::string text, const std::string &from, const std::string &to) {
+    for (size_t at = text.find(from); at != std::string::npos; at = text.find(from, at + to.size())) {
+        text.replace(at, from.size(), to);
+    }
+    return text;
+}
+
+CompilationResult compileSolution(std::string pathToSolution, std::string compileErrorsPath, std::string pathToCompiledSolution,
+                                  const std::atomic<bool> *cancelled = nullptr) {
     // std::cout << "Compiling solution..." << std::endl;
     // std::cout << "Path to solution: " << pathToSolution << std::endl;
     // std::cout << "The solution: " << std::endl;
@@ -175,44 +491,85 @@ CompilationResult compileSolution(std::string pathToSolution, std::string compil
     // system(cat_command.c_str());
     // std::cout << std::endl << std::endl;
 
-    const std::string compilationCommand = "g++ " + pathToSolution + " -o " + pathToCompiledSolution + " 2> " + compileErrorsPath;
+    const std::string compilationCommand = replaceAll(replaceAll(compileCommand, "{source}", pathToSolution), "{binary}", pathToCompiledSolution) +
+                                           " 2> " + compileErrorsPath;
 
-    int compilationResult = system(compilationCommand.c_str());
+    int compilationResult = runCommand(compilationCommand, cancelled);
     if (compilationResult != 0) {
         return CompilationFailed;
     }
     return CompilationSuccess;
 }
 
-TestResult testSolution(std::string pathToCompiledSolution, std::string pathToDiffOutput = "diffOutput.txt") {
-    std::string pathToTestDir = getUsersPathToTestDir();
+// the .in files of a tests directory in order, listed again only when the directory changed (e.g. a stress test was added)
+std::vector<fs::path> listTestInputs(const std::string &pathToTestDir) {
+    static std::mutex mutex;
+    static std::map<std::string, std::pair<fs::file_time_type, std::vector<fs::path>>> manifests;
+    std::error_code error;
+    fs::file_time_type modified = fs::last_write_time(pathToTestDir, error);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = manifests.find(pathToTestDir);
+    if (!error && found != manifests.end() && found->second.first == modified) {
+        return found->second.second;
+    }
     std::set<fs::path> testInputs;
-    std::set<fs::path> testOutputs;
     for (const auto &entry: fs::directory_iterator(pathToTestDir)) {
         LOG(entry.path().string() + " " + entry.path().extension().string() + " " + entry.path().filename().string() + "\n");
         if (entry.path().extension().string() == ".in") {
             testInputs.insert(entry.path());
         }
     }
+    std::vector<fs::path> inputs(testInputs.begin(), testInputs.end());
+    if (!error) {
+        manifests[pathToTestDir] = {modified, inputs};
+    }
+    return inputs;
+}
 
-    int testsPassed = 0;
+// the tests stop with a run failure once they used cpuSecondsLimit CPU seconds together, 0 for no limit
+TestResult testSolution(std::string pathToCompiledSolution, std::string pathToDiffOutput,
+                        std::string pathToSatoriGPTOutput, const std::atomic<bool> *cancelled = nullptr,
+                        std::string pathToTestDir = getUsersPathToTestDir(), double cpuSecondsLimit = 0) {
+    std::vector<fs::path> testInputs = listTestInputs(pathToTestDir);
 
+    TestResult result(Correct);
+    result.total = testInputs.size();
+    RunUsage usage;
     for (auto path: testInputs) {
-        std::string runCommand = "./" + pathToCompiledSolution + " < " + path.string() + " > " + pathToSatoriGPTOutput;
-        int runResult = system(runCommand.c_str());
+        // the output and diff of the first failing test are kept for the prompt, the later tests only count
+        std::string outputPath = result.failingTest ? pathToSatoriGPTOutput + ".next" : pathToSatoriGPTOutput;
+        std::string diffPath = result.failingTest ? pathToDiffOutput + ".next" : pathToDiffOutput;
+        std::string runCommand = executable(pathToCompiledSolution) + " < " + path.string() + " > " + outputPath;
+        double cpuSecondsLeft = cpuSecondsLimit - usage.cpuSeconds;
+        int runResult = cpuSecondsLimit > 0 && cpuSecondsLeft <= 0 ? 128 + SIGXCPU :
+                        ::runCommand(runCommand, cancelled, &usage, cpuSecondsLimit > 0 ? cpuSecondsLeft : 0);
         if (runResult != 0) {
-            return TestResult(RunFailed);
+            if (!result.failingTest) {
+                result.status = RunFailed;
+                result.failingTest = path.filename().string();
+            }
+            if (failFast || runResult < 0) {
+                break;
+            }
+            continue;
         }
 
-        std::string diffCommand = "diff -b " + pathToSatoriGPTOutput + " " +
-                                  changeExtension(path.string(), 3, ".out") + " > " + pathToDiffOutput;
+        std::string diffCommand = "diff -b " + outputPath + " " +
+                                  changeExtension(path.string(), 3, ".out") + " > " + diffPath;
         LOG(diffCommand + "\n");
-        int filesAreDifferent = system(diffCommand.c_str());
+        int filesAreDifferent = ::runCommand(diffCommand, cancelled);
         if (filesAreDifferent) {
             LOG("Test " + path.filename().string() + "\033[31m failed\n \033[0m");
             // std::cout<<"Test "<<path.filename().string()<<"\033[31m"<<" FAILED"<<std::endl;
             // std::cout<<"\033[0m";
-            return TestResult(Incorrect, path.filename().string());
+            if (!result.failingTest) {
+                result.status = Incorrect;
+                result.failingTest = path.filename().string();
+            }
+            if (failFast || filesAreDifferent < 0) {
+                break;
+            }
+            continue;
         }
 
         LOG("Test " + path.filename().string() + "\033[32m PASSED\n \033[0m");
@@ -220,16 +577,24 @@ TestResult testSolution(std::string pathToCompiledSolution, std::string pathToDi
         // std::cout<<"Test "<<path.filename().string()<<"\033[32m"<<" PASSED"<<std::endl;
         // std::cout<<"\033[0m"; // reset text color
 
-        testsPassed++;
+        result.passed++;
     }
 
-    return TestResult(Correct);
+    result.cpuSeconds = usage.cpuSeconds;
+    result.maxMemoryKb = usage.maxMemoryKb;
+    return result;
 
 }
 
 // remove everything before the first ``` and after the last ``` if there are strays
-void destray(std::string filename) {
+void destray(std::string filename, bool codeOnly = false) {
     std::ifstream file(filename);
+    // code-only responses arrive without the fence, only ones recorded before that need the rest
+    std::string firstWord;
+    if (codeOnly && (!(file >> firstWord) || firstWord.rfind("```", 0) != 0)) {
+        return;
+    }
+    file.seekg(0);
     std::string fileContents;
     std::string line;
     bool foundFirst = false;
@@ -255,46 +620,612 @@ void destray(std::string filename) {
     newFile.close();
 }
 
-std::string getStringWithFileContents(std::string path) {
-    std::string solutionString;
-    std::ifstream solutionFile(path);
-    if (solutionFile) {
-        std::string line;
-        while (std::getline(solutionFile, line)) {
-            solutionString += line + '\n';
+// Bounds the checks against the reference solution of a stress test or a shrinking by the problem's budget: they stop
+// once it is cancelled or out of time or test CPU time, and the CPU time they use is added to it. Shared by the
+// threads of the checks, they are the only ones using spent meanwhile.
+class CheckBudget {
+    std::mutex mutex;
+    BudgetTracker &spent;
+
+public:
+    const std::atomic<bool> *cancelled;
+
+    CheckBudget(BudgetTracker &spent, const std::atomic<bool> *cancelled) : spent(spent), cancelled(cancelled) {}
+
+    bool exhausted() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return (cancelled && *cancelled) || spent.timeOrCpuExhausted();
+    }
+
+    void add(const RunUsage &usage) {
+        std::lock_guard<std::mutex> lock(mutex);
+        spent.addTestCpu(usage.cpuSeconds);
+    }
+};
+
+// files of one thread of a check against the reference solution, base.in, base.out and base.ref
+std::string checkFiles(const Workspace &workspace, int worker) {
+    return workspace.file("check_" + std::to_string(worker));
+}
+
+enum CheckOutcome {
+    InvalidInput, Crashed, WrongAnswer, Passed
+};
+
+// runs the solution and the reference on base.in, the outputs are left in base.out and base.ref; a check stopped by
+// budget counts as invalid input
+CheckOutcome checkAgainstReference(const std::string &compiled, const std::string &base, CheckBudget *budget = nullptr) {
+    std::string timeLimit = "timeout " + std::to_string(checkTimeLimit) + " ";
+    const std::atomic<bool> *cancelled = budget ? budget->cancelled : nullptr;
+    RunUsage usage;
+    auto outcome = [&] {
+        if (!inputValidator.empty() && runCommand(inputValidator + " < " + base + ".in > /dev/null 2>&1", cancelled) != 0) {
+            return InvalidInput;
         }
-        solutionFile.close();
+        if (runCommand(timeLimit + referenceSolution + " < " + base + ".in > " + base + ".ref 2> /dev/null", cancelled, &usage) != 0) {
+            return InvalidInput;
+        }
+        int solution = runCommand(timeLimit + executable(compiled) + " < " + base + ".in > " + base + ".out 2> /dev/null", cancelled, &usage);
+        if (solution != 0) {
+            return solution < 0 ? InvalidInput : Crashed;
+        }
+        return runCommand("diff -b -q " + base + ".out " + base + ".ref > /dev/null") != 0 ? WrongAnswer : Passed;
+    }();
+    if (budget) {
+        budget->add(usage);
     }
-    return solutionString;
+    return outcome;
 }
 
-std::string createProblemStatementPrompt(std::string problemDescription) {
-    return "Write a solution to the following problem: " + problemDescription +
-            ", write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.";
+// Shrinks the failing test to the smallest input on which the solution still fails compared with the reference
+// solution, returns the input and both outputs for the prompt. Empty when there is no reference or the test is small
+// enough to be shown as it is. The caller holds a CPU worker, the other threads use workers that are free.
+std::string minimizeFailingInput(const std::string &compiled, const std::string &failingTest,
+                                 const std::string &testsDir = getUsersPathToTestDir(), CheckBudget *budget = nullptr) {
+    fs::path input = fs::path(testsDir) / failingTest;
+    std::error_code error;
+    if (referenceSolution.empty() || fs::file_size(input, error) <= maxDiffInputBytes || error) {
+        return "";
+    }
+    Workspace workspace(workspaceRoot, keepWorkspaces);
+    auto run = [&](const std::vector<std::string> &lines, int worker) {
+        std::string base = checkFiles(workspace, worker);
+        std::ofstream(base + ".in") << joinLines(lines);
+        return checkAgainstReference(compiled, base, budget);
+    };
+    auto fails = [&](const std::vector<std::string> &lines, int worker) {
+        CheckOutcome outcome = run(lines, worker);
+        return outcome == Crashed || outcome == WrongAnswer;
+    };
+
+    std::vector<std::string> lines = readLines(input.string());
+    if (!fails(lines, 0)) {
+        LOG("The reference solution agrees with the failing output of " + failingTest + ", not shrinking it\n", 1);
+        return "";
+    }
+    SemaphoreShare moreWorkers(cpuWorkerPool.get(), std::max<int>(std::thread::hardware_concurrency(), 1) - 1);
+    DeltaDebugger debugger(fails, 1 + moreWorkers.count(), minimizeMaxTests);
+    std::vector<std::string> minimal = debugger.minimize(lines, [budget] { return budget && budget->exhausted(); });
+    if (budget && budget->exhausted()) {
+        LOG("Stopped shrinking " + failingTest + ", the problem is out of its budget\n", 1);
+        return "";
+    }
+    LOG("Shrunk " + failingTest + " from " + std::to_string(lines.size()) + " to " + std::to_string(minimal.size()) +
+        " lines in " + std::to_string(debugger.testsRun()) + " runs\n", 1);
+
+    // the files of worker 0 hold some other input now
+    bool crashed = run(minimal, 0) == Crashed;
+    std::string base = checkFiles(workspace, 0);
+    std::string text = "Here is a small input on which your solution fails:\n" + joinLines(minimal) +
+                       "Expected output:\n" + getStringWithFileContents(base + ".ref") +
+                       (crashed ? "Your program crashed on it.\n" : "Your output:\n" + getStringWithFileContents(base + ".out"));
+    return text;
 }
 
-std::string createCompilationFailedPrompt(std::string problemDescription, std::string compilationLog, std::string failingCode, std::string userInstructions) {
-    return "You tried to solve a problem with the following description: " + problemDescription +
-            ", You wrote this solution: " + failingCode +
-            ", This approach fails during compilation. Here is a log: " + compilationLog +
-            (userInstructions != "" ? (", Here are some tips on how you can better approach this problem: " + userInstructions)  : "") +
-            ", Try to write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.";
+// makes room for a new stress test in testsDir, removes the oldest ones while maxStressTestsKept are there
+void evictStressTests(const std::string &testsDir) {
+    std::vector<std::pair<fs::file_time_type, fs::path>> kept;
+    std::error_code error;
+    for (const auto &entry: fs::directory_iterator(testsDir, error)) {
+        std::string name = entry.path().filename().string();
+        if (name.rfind("stress_", 0) == 0 && entry.path().extension() == ".in") {
+            kept.emplace_back(entry.last_write_time(error), entry.path());
+        }
+    }
+    std::sort(kept.begin(), kept.end());
+    for (size_t i = 0; i + std::max(maxStressTestsKept, 1) <= kept.size(); i++) {
+        fs::remove(kept[i].second, error);
+        fs::remove(changeExtension(kept[i].second.string(), 3, ".out"), error);
+    }
 }
 
-std::string createIncorrectResultPrompt(std::string problemDescription, std::string testLog, std::string failingCode, std::string userInstructions) {
-    return "You tried to solve a problem with the following description: " + problemDescription +
-           ", You wrote this solution: " + failingCode +
-           ", This approach doesn't solve some of the test cases. Here is a log: " + testLog +
-           (userInstructions != "" ? (", Here are some tips on how you can better approach this problem: " + userInstructions)  : "") +
-           ", Try to write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.";
+// Compares the solution with the reference on generated tests, on the caller's CPU worker and the ones that are free.
+// The first failing test is added to the tests directory (as stress_<seed>.in/out, at most maxStressTestsKept of
+// them) so later solutions are checked against it too, its name is returned and the solution's output on it is left
+// in outputPath. Stops early when budget runs out.
+std::optional<std::string> stressTest(const std::string &compiled, const std::string &outputPath,
+                                      const std::string &testsDir = getUsersPathToTestDir(), CheckBudget *budget = nullptr) {
+    if (stressGenerator.empty() || referenceSolution.empty()) {
+        return std::nullopt;
+    }
+    SemaphoreShare moreWorkers(cpuWorkerPool.get(), std::max<int>(std::thread::hardware_concurrency(), 1) - 1);
+    Workspace workspace(workspaceRoot, keepWorkspaces);
+    std::string generate = "timeout " + std::to_string(checkTimeLimit) + " " + stressGenerator + " ";
+    StressTester tester([&](int seed, int worker) {
+        std::string base = checkFiles(workspace, worker);
+        if (runCommand(generate + std::to_string(seed) + " > " + base + ".in 2> /dev/null") != 0) {
+            return false;
+        }
+        CheckOutcome outcome = checkAgainstReference(compiled, base, budget);
+        return outcome == Crashed || outcome == WrongAnswer;
+    }, 1 + moreWorkers.count());
+    std::optional<int> seed = tester.run(stressTests, [budget] { return budget && budget->exhausted(); });
+    if (!seed) {
+        LOG(budget && budget->exhausted() ? "Stopped the stress tests, the problem is out of its budget\n" :
+            "Passed " + std::to_string(stressTests) + " stress tests\n", 1);
+        return std::nullopt;
+    }
+
+    // the failing seed is run again, its files may have been overwritten by a later seed
+    std::string base = checkFiles(workspace, 0);
+    std::string test = "stress_" + std::to_string(*seed);
+    fs::path testPath = fs::path(testsDir) / test;
+    CheckOutcome outcome = runCommand(generate + std::to_string(*seed) + " > " + base + ".in 2> /dev/null") == 0 ?
+                           checkAgainstReference(compiled, base, budget) : InvalidInput;
+    if (outcome != Crashed && outcome != WrongAnswer) {
+        LOG("Stress test " + std::to_string(*seed) + " failed once but not again, not adding it\n", 1);
+        return std::nullopt;
+    }
+    // problems of a batch may share the tests directory
+    static std::mutex testsMutex;
+    std::lock_guard<std::mutex> lock(testsMutex);
+    evictStressTests(testsDir);
+    fs::copy_file(base + ".in", testPath.string() + ".in", fs::copy_options::overwrite_existing);
+    fs::copy_file(base + ".ref", testPath.string() + ".out", fs::copy_options::overwrite_existing);
+    fs::copy_file(base + ".out", outputPath, fs::copy_options::overwrite_existing);
+    LOG("Stress test " + std::to_string(*seed) + " failed, added it as " + testPath.string() + ".in\n", 1);
+    return test + ".in";
+}
+
+// all prompts start with the same text so the server can reuse the evaluated prefix from its prompt cache
+std::string createProblemPrefix(std::string problemDescription) {
+    return "You are solving a problem with the following description: " + problemDescription;
+}
+
+// what is left of the context after the generated tokens, with some room for the tokenizers disagreeing
+int promptTokenBudget() {
+    return generationOptions.contextSize.value_or(4096) - generationOptions.maxTokens.value_or(0) - 32;
 }
 
-std::string createRunFailedPrompt(std::string problemDescription, std::string failingCode, std::string userInstructions) {
-    return "You tried to solve a problem with the following description: " + problemDescription +
-           ", You wrote this solution: " + failingCode +
-           ", This approach failed during the runtime." +
-           (userInstructions != "" ? (", Here are some tips on how you can better approach this problem: " + userInstructions)  : "") +
-           ", Try to write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.";
+// the prompts are counted with the tokenizer of the problem's model, so they fit into its context
+std::string createProblemStatementPrompt(const PromptBuilder::TokenCounter &countTokens, std::string problemDescription) {
+    return PromptBuilder(promptTokenBudget(), countTokens)
+            .add(createProblemPrefix(problemDescription))
+            .add(", write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.")
+            .build();
+}
+
+std::string userTips(std::string userInstructions) {
+    return userInstructions != "" ? (", Here are some tips on how you can better approach this problem: " + userInstructions) : "";
+}
+
+std::string createCompilationFailedPrompt(const PromptBuilder::TokenCounter &countTokens, std::string problemDescription, std::string compilationLog, std::string failingCode, std::string userInstructions) {
+    return PromptBuilder(promptTokenBudget(), countTokens)
+            .add(createProblemPrefix(problemDescription))
+            .add(", You wrote this solution: " + failingCode)
+            .add(", This approach fails during compilation. Here is a log: ")
+            .add(compilationLog, PromptBuilder::Head)
+            .add(userTips(userInstructions), PromptBuilder::Head)
+            .add(", Try to write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.")
+            .build();
+}
+
+std::string createIncorrectResultPrompt(const PromptBuilder::TokenCounter &countTokens, std::string problemDescription, std::string testLog, std::string failingCode, std::string userInstructions) {
+    return PromptBuilder(promptTokenBudget(), countTokens)
+            .add(createProblemPrefix(problemDescription))
+            .add(", You wrote this solution: " + failingCode)
+            .add(", This approach doesn't solve some of the test cases. Here is a log: ")
+            .add(testLog, PromptBuilder::Middle)
+            .add(userTips(userInstructions), PromptBuilder::Head)
+            .add(", Try to write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.")
+            .build();
+}
+
+std::string createRepeatedSolutionPrompt(const PromptBuilder::TokenCounter &countTokens, std::string problemDescription, std::string repeatedCode, std::string verdict,
+                                         std::string userInstructions) {
+    return PromptBuilder(promptTokenBudget(), countTokens)
+            .add(createProblemPrefix(problemDescription))
+            .add(", You wrote this solution: " + repeatedCode)
+            .add(", This is the same program as one you already wrote, only formatted or named differently. " + verdict)
+            .add(userTips(userInstructions), PromptBuilder::Head)
+            .add(", Try a different approach and write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.")
+            .build();
+}
+
+std::string createRunFailedPrompt(const PromptBuilder::TokenCounter &countTokens, std::string problemDescription, std::string failingCode, std::string userInstructions,
+                                  std::string failingInput = "") {
+    return PromptBuilder(promptTokenBudget(), countTokens)
+            .add(createProblemPrefix(problemDescription))
+            .add(", You wrote this solution: " + failingCode)
+            .add(", This approach failed during the runtime.")
+            .add(failingInput.empty() ? "" : " " + failingInput, PromptBuilder::Middle)
+            .add(userTips(userInstructions), PromptBuilder::Head)
+            .add(", Try to write a correct solution to the problem in C++. Output only C++ code, DO NOT output any explanation or comments about the code.")
+            .build();
+}
+
+// one problem to solve, the single problem of an interactive run or one directory of a batch
+struct Problem {
+    std::string name;
+    std::string description;
+    std::string testsDir;
+    // the solution and the other files are written here, empty for the working directory
+    std::string workDir;
+    // asks the user for tips every few rounds and streams the generated code to the terminal
+    bool interactive = true;
+    // set from outside to stop solving, the running round is cancelled
+    const std::atomic<bool> *cancelled = nullptr;
+    // called with the journal entry of every finished round and the code of the best compiled candidate so far
+    // (empty while none compiled)
+    std::function<void(const nlohmann::json &, const std::string &)> onRound;
+};
+
+// where the solution passing all tests is copied to
+std::string problemOutput(const Problem &problem, const std::string &file) {
+    return problem.workDir.empty() ? file : (fs::path(problem.workDir) / file).string();
+}
+
+struct Attempt {
+    // shared so the attempt can be copied, the workspace is removed with its last copy after the round
+    std::shared_ptr<Workspace> files;
+    CompilationResult compilation = CompilationFailed;
+    TestResult test = TestResult(RunFailed);
+    // another candidate passed first, the verdict of this one is meaningless
+    bool cancelled = false;
+    // the model gave no answer, there is nothing to compile
+    bool generationFailed = false;
+    int generatedTokens = 0;
+    // the time of its generation, 0 when it was taken from the journal
+    double generationMs = 0;
+    // the same program was tested before, the verdict is the earlier one and the workspace has only the solution
+    uint64_t fingerprint = 0;
+    bool duplicate = false;
+};
+
+// the verdicts of a problem's candidates by fingerprint
+class SeenCandidates {
+    std::mutex mutex;
+    std::map<uint64_t, std::pair<CompilationResult, TestResult>> verdicts;
+
+public:
+    std::optional<std::pair<CompilationResult, TestResult>> find(uint64_t fingerprint) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = verdicts.find(fingerprint);
+        if (found == verdicts.end()) {
+            return std::nullopt;
+        }
+        return found->second;
+    }
+
+    void record(uint64_t fingerprint, CompilationResult compilation, const TestResult &test) {
+        std::lock_guard<std::mutex> lock(mutex);
+        verdicts.insert_or_assign(fingerprint, std::make_pair(compilation, test));
+    }
+};
+
+// candidates of one round differ in seed and temperature, otherwise they would mostly be the same program
+GenerationOptions candidateOptions(const GenerationOptions &options, int index) {
+    if (index == 0) {
+        return options;
+    }
+    GenerationOptions candidate = options;
+    candidate.seed = options.seed.value_or(0) + index;
+    candidate.temperature = std::min(options.temperature.value_or(escalationPolicy.baseTemperature) + index * candidateTemperatureSpread,
+                                     escalationPolicy.maxTemperature);
+    return candidate;
+}
+
+// candidate i of every round uses the same slot, so its prompt prefix stays cached there
+std::string candidateAffinityKey(const Problem &problem, int index) {
+    return problem.name + "#" + std::to_string(index);
+}
+
+// saves the server's cache of every candidate slot of the problem, or restores it when a session is resumed
+void transferSlots(LLMBackend &backend, const Problem &problem, bool restore) {
+    int restored = 0;
+    for (int i = 0; i < std::max(candidatesPerRound, 1); i++) {
+        backend.setAffinityKey(candidateAffinityKey(problem, i));
+        // the server takes only file names, not paths
+        std::string file = "slot_" + toHex(fnv1a(problem.name)) + "_" + std::to_string(i) + ".bin";
+        restored += restore ? backend.restoreCache(file) : backend.saveCache(file);
+    }
+    if (restore) {
+        LOG("Restored " + std::to_string(restored) + " slots of the server's prompt cache\n", 1);
+    }
+}
+
+// one candidate travelling through the pipeline, done is set once its attempt is final
+struct CandidateJob {
+    const Problem *problem;
+    std::string model;
+    std::string prompt;
+    GenerationOptions options;
+    std::string stage;
+    int index = 0;
+    // candidates in the round
+    int candidates = 1;
+    // set by the first candidate of the round that passes (or at the deadline), null when nothing stops the round early
+    std::atomic<bool> *solved = nullptr;
+    // the test CPU time left in the problem's budget, 0 for no limit
+    double testCpuSeconds = 0;
+    // the answer is appended to the journal, or taken from it when the session is resumed
+    SessionJournal *journal = nullptr;
+    int round = 0;
+    const nlohmann::json *answered = nullptr;
+    // null when duplicates aren't looked for
+    SeenCandidates *seen = nullptr;
+    Attempt attempt;
+    std::promise<void> done;
+};
+
+// generate -> extract -> compile -> test, every stage with its own workers and a bounded queue in front of it, so
+// while one candidate is generated others are compiled and tested. Compilations and test runs hold a CPU worker
+// (cpuWorkerPool) as they share the cores with the stress tests and the input shrinking.
+class CandidatePipeline {
+    using Job = std::shared_ptr<CandidateJob>;
+
+    static void finish(Job &job) {
+        Attempt &attempt = job->attempt;
+        attempt.cancelled = attempt.cancelled || (job->solved && job->solved->load());
+        if (job->seen && !attempt.cancelled && !attempt.duplicate && !attempt.generationFailed) {
+            job->seen->record(attempt.fingerprint, attempt.compilation, attempt.test);
+        }
+        if (job->solved && !attempt.cancelled && attempt.compilation == CompilationSuccess && attempt.test.status == Correct) {
+            *job->solved = true;
+        }
+        job->done.set_value();
+    }
+
+    static bool cancelled(const Job &job) {
+        return job->solved && job->solved->load();
+    }
+
+    // declared in reverse, so generate is stopped first and the later stages can still take its last candidates
+    Stage<Job> test;
+    Stage<Job> compile;
+    Stage<Job> extract;
+    Stage<Job> generate;
+
+public:
+    CandidatePipeline(int llmWorkers, int cpuWorkers)
+            : test("test", cpuWorkers, 2 * cpuWorkers, [](Job &job) {
+                  if (!cancelled(job)) {
+                      SemaphoreGuard worker(cpuWorkerPool.get());
+                      Workspace &files = *job->attempt.files;
+                      job->attempt.test = testSolution(files.compiled, files.diffOutput, files.output, job->solved, job->problem->testsDir,
+                                                                    job->testCpuSeconds);
+                  }
+                  finish(job);
+              }),
+              compile("compile", cpuWorkers, 2 * cpuWorkers, [this](Job &job) {
+                  if (!cancelled(job)) {
+                      SemaphoreGuard worker(cpuWorkerPool.get());
+                      Workspace &files = *job->attempt.files;
+                      job->attempt.compilation = compileSolution(files.solution, files.compileErrors, files.compiled, job->solved);
+                  }
+                  if (job->attempt.compilation == CompilationSuccess && !cancelled(job)) {
+                      test.submit(job);
+                  } else {
+                      finish(job);
+                  }
+              }),
+              extract("extract", 1, 2 * llmWorkers, [this](Job &job) {
+                  Attempt &attempt = job->attempt;
+                  destray(attempt.files->solution, job->options.codeOnly);
+                  if (job->seen) {
+                      attempt.fingerprint = codeFingerprint(getStringWithFileContents(attempt.files->solution), fingerprintRenaming);
+                      if (auto verdict = job->seen->find(attempt.fingerprint)) {
+                          attempt.compilation = verdict->first;
+                          attempt.test = verdict->second;
+                          // nothing ran, so nothing is counted against the budget
+                          attempt.test.cpuSeconds = 0;
+                          attempt.duplicate = true;
+                          finish(job);
+                          return;
+                      }
+                  }
+                  compile.submit(job);
+              }),
+              generate("generate", llmWorkers, 2 * llmWorkers, [this](Job &job) {
+                  Attempt &attempt = job->attempt;
+                  attempt.files = std::make_shared<Workspace>(workspaceRoot, keepWorkspaces);
+                  if (job->answered) {
+                      // generated before the session was interrupted
+                      std::ofstream(attempt.files->solution) << job->answered->value("response", "");
+                      attempt.generatedTokens = job->answered->value("generatedTokens", 0);
+                      extract.submit(job);
+                      return;
+                  }
+                  Assistant assistant(attempt.files->solution, job->model);
+                  assistant.cancelled = job->solved;
+                  assistant.server().setAffinityKey(candidateAffinityKey(*job->problem, job->index));
+                  if (job->candidates > 1 || !job->problem->interactive) {
+                      // several candidates stream at once, their tokens would only interleave on the terminal
+                      assistant.verbose = 0;
+                  }
+                  auto start = std::chrono::steady_clock::now();
+                  bool finished = assistant.prompt(job->prompt, candidateOptions(job->options, job->index), job->stage);
+                  attempt.generatedTokens = assistant.generatedTokens;
+                  attempt.generationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                  if (!finished) {
+                      // stopped for a passing candidate, or the request failed
+                      attempt.cancelled = cancelled(job);
+                      attempt.generationFailed = !attempt.cancelled;
+                      finish(job);
+                      return;
+                  }
+                  if (job->journal) {
+                      job->journal->append({
+                          {"type", "candidate"}, {"round", job->round}, {"index", job->index}, {"model", job->model},
+                          {"stage", job->stage}, {"response", getStringWithFileContents(attempt.files->solution)},
+                          {"generatedTokens", attempt.generatedTokens},
+                          {"ms", attempt.generationMs}
+                      });
+                  }
+                  extract.submit(job);
+              }) {}
+
+    std::future<void> submit(std::shared_ptr<CandidateJob> job) {
+        std::future<void> done = job->done.get_future();
+        generate.submit(job);
+        return done;
+    }
+
+    void printStats(std::ostream &out) {
+        Stage<Job>::printHeader(out);
+        generate.printStats(out);
+        extract.printStats(out);
+        compile.printStats(out);
+        test.printStats(out);
+    }
+};
+
+std::unique_ptr<CandidatePipeline> candidatePipeline;
+
+// generates candidatesPerRound solutions to prompt at once, each one is compiled and tested as soon as its
+// generation ends, the first one passing all tests stops everything else that is still generating or testing.
+// Candidates in answered (by index) were generated before the session was interrupted and aren't generated again.
+// Whatever still runs at the deadline of spent is cancelled, the tests get the CPU time left in it.
+std::vector<Attempt> runRound(const Problem &problem, const std::string &model, const std::string &prompt,
+                              const GenerationOptions &options, const std::string &stage, SessionJournal *journal = nullptr,
+                              int round = 0, const std::map<int, nlohmann::json> &answered = {}, SeenCandidates *seen = nullptr,
+                              const BudgetTracker *spent = nullptr) {
+    int candidates = std::max(candidatesPerRound, 1);
+    std::optional<std::chrono::steady_clock::time_point> deadline = spent ? spent->deadline() : std::nullopt;
+    std::atomic<bool> solved = false;
+    std::vector<std::shared_ptr<CandidateJob>> jobs;
+    std::vector<std::future<void>> done;
+    for (int i = 0; i < candidates; i++) {
+        auto job = std::make_shared<CandidateJob>();
+        job->problem = &problem;
+        job->model = model;
+        job->prompt = prompt;
+        job->options = options;
+        job->stage = stage;
+        job->index = i;
+        job->candidates = candidates;
+        job->solved = candidates > 1 || problem.cancelled || deadline ? &solved : nullptr;
+        job->testCpuSeconds = spent ? spent->testCpuSecondsLeft() : 0;
+        job->journal = journal;
+        job->round = round;
+        auto found = answered.find(i);
+        job->answered = found == answered.end() ? nullptr : &found->second;
+        job->seen = seen;
+        jobs.push_back(job);
+        done.push_back(candidatePipeline->submit(job));
+    }
+    std::vector<Attempt> attempts;
+    for (int i = 0; i < candidates; i++) {
+        // cancelling the problem or running out of time stops the round like a passing candidate does
+        while (done[i].wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+            if ((problem.cancelled && *problem.cancelled) || (deadline && std::chrono::steady_clock::now() >= *deadline)) {
+                solved = true;
+            }
+        }
+        attempts.push_back(jobs[i]->attempt);
+    }
+    return attempts;
+}
+
+// how close an attempt is to passing: the share of tests passed, then the verdict of its first failing test; of the
+// passing ones the faster and then the smaller one. CPU time and memory vary between runs, so they don't decide
+// which failing attempt is repaired, that would make the rounds differ from a replay.
+std::tuple<double, int, double, long> attemptRank(const Attempt &attempt) {
+    if (attempt.cancelled || attempt.generationFailed || attempt.compilation == CompilationFailed) {
+        return {0, attempt.cancelled || attempt.generationFailed ? 0 : 1, 0, 0};
+    }
+    int verdict = attempt.test.status == RunFailed ? 2 : attempt.test.status == Incorrect ? 3 : 4;
+    double passRatio = attempt.test.total ? (double) attempt.test.passed / attempt.test.total : 0;
+    if (attempt.test.status != Correct) {
+        return {passRatio, verdict, 0, 0};
+    }
+    return {passRatio, verdict, -attempt.test.cpuSeconds, -attempt.test.maxMemoryKb};
+}
+
+// The best candidates of a problem so far, best first. Their workspaces are kept, so the best one can be repaired
+// again when a round brings only worse ones, and written out when the budget runs out.
+class CandidateRanking {
+public:
+    struct Entry {
+        Attempt attempt;
+        int round;
+        int index;
+    };
+
+private:
+    std::vector<Entry> entries;
+    size_t capacity;
+
+public:
+    explicit CandidateRanking(size_t capacity) : capacity(std::max<size_t>(capacity, 1)) {}
+
+    // cancelled candidates and repeated programs aren't ranked
+    void add(const Attempt &attempt, int round, int index) {
+        if (attempt.cancelled || attempt.generationFailed || attempt.duplicate || !attempt.files) {
+            return;
+        }
+        auto worse = std::find_if(entries.begin(), entries.end(), [&](const Entry &entry) {
+            return attemptRank(attempt) > attemptRank(entry.attempt);
+        });
+        entries.insert(worse, {attempt, round, index});
+        if (entries.size() > capacity) {
+            entries.pop_back();
+        }
+    }
+
+    bool empty() const {
+        return entries.empty();
+    }
+
+    const Entry &best() const {
+        return entries.front();
+    }
+
+    const std::vector<Entry> &all() const {
+        return entries;
+    }
+};
+
+// a passing candidate if there is one, otherwise the one closest to passing is repaired in the next round; a new
+// program is preferred to one that was already repaired
+const Attempt &pickAttempt(const std::vector<Attempt> &attempts) {
+    auto rank = [](const Attempt &attempt) {
+        return std::make_pair(!attempt.duplicate && !attempt.cancelled && !attempt.generationFailed, attemptRank(attempt));
+    };
+    const Attempt *best = &attempts[0];
+    for (const Attempt &attempt: attempts) {
+        if (rank(attempt) > rank(*best)) {
+            best = &attempt;
+        }
+    }
+    return *best;
+}
+
+void printLatencySummary() {
+    std::cout << bold << "LLM calls:" << reset << std::endl;
+    latencyLog.printSummary(std::cout);
+    if (backendPool) {
+        backendPool->printStats(std::cout);
+    }
+    if (responseCache) {
+        std::cout << "response cache: " << responseCache->hits << " hits, " << responseCache->misses << " misses ("
+                  << (int) (responseCache->hitRate() * 100) << "% hit rate), " << responseCache->evictions << " evicted" << std::endl;
+    }
+}
+
+void printPipelineSummary() {
+    std::cout << bold << "Pipeline:" << reset << std::endl;
+    candidatePipeline->printStats(std::cout);
 }
 
 void bye() {
@@ -311,71 +1242,949 @@ void greetings() {
     std::cout << yellow << "The solution will be written to the file " << bold << red << pathToSolution << reset << std::endl;
     std::cout << yellow << "The compiled solution will be written to the file " << bold << red << pathToCompiledSolution << reset << std::endl;
     std::cout << std::endl;
-    std::cout << cyan << "This project currently uses Ollama. Model used: " << bold << blue << usedModel << reset << std::endl;
+    std::cout << cyan << "This project currently uses " << backendKind << ". Model used: " << bold << blue
+              << (modelCascade.empty() ? usedModel : modelCascade.front().model) << reset << std::endl;
+    if (modelCascade.size() > 1) {
+        std::cout << cyan << "Models are escalated on repeated failures: " << bold << blue
+                  << ModelCascade(modelCascade).describe() << reset << std::endl;
+    }
     std::cout << bold << "------------------------------------------------------------" << reset << std::endl;
 }
 
-int main() {
-    greetings();
-
-    std::string problemDescription = getUsersProblemDescription();
+struct ProblemResult {
+    std::string name;
+    bool solved = false;
+    int tries = 0;
+    double seconds = 0;
+    // verdict of the last round
+    std::string status;
+    std::string solution;
+    // why an unsolved problem was given up, its best candidate passed passed of total tests
+    std::string stopReason;
+    int passed = 0;
+    int total = 0;
+    long long generatedTokens = 0;
+    double testCpuSeconds = 0;
+    // how the models of the cascade did
+    std::map<std::string, ModelCascade::ModelStats> modelStats;
+};
 
-    std::string onlyCodePrompt = " Write only the c++ code that will compile.";
+// the models tried in turn, just the one model without a cascade
+std::vector<CascadeStep> cascadeSteps() {
+    return modelCascade.empty() ? std::vector<CascadeStep>{{usedModel, 1}} : modelCascade;
+}
 
-    if (problemDescription.empty()) {
-        std::cout<<"Couldn't read problem description!"<<std::endl;
-        return 1;
+// the models of the cascade over the problems of results
+void printCascadeSummary(const std::vector<ProblemResult> &results) {
+    ModelCascade report(cascadeSteps());
+    for (const ProblemResult &result: results) {
+        report.addStats(result.modelStats);
     }
+    report.printReport(std::cout);
+}
 
-    Assistant assistant(pathToSolution, usedModel);
+// the repair loop: prompts, compiles and tests until a solution passes all tests or a limit of the budget is
+// reached, then the candidate that passed the most tests is written out instead
+ProblemResult solveProblem(const Problem &problem, const Budget &limits = budget) {
+    BudgetTracker spent(limits);
+    ProblemResult result;
+    result.name = problem.name;
+    std::string problemDescription = problem.description;
 
-    assistant.prompt(createProblemStatementPrompt(problemDescription));
-    destray(pathToSolution);
+    // the tokenizer of this thread's prompts, with its own connection as the candidates have theirs
+    std::unique_ptr<LLMBackend> tokenizer = createBackend();
+    ModelCascade cascade(cascadeSteps(), cascadeRepeatsBeforeEscalation);
+    PromptBuilder::TokenCounter countTokens = [&](const std::string &text) { return tokenizer->countTokens(cascade.model(), text); };
+    std::string prompt = createProblemStatementPrompt(countTokens, problemDescription);
+    std::string stage = "initial";
+    GenerationOptions options = generationOptions;
     int tries = 0;
+    // how many times in a row the last failure came back unchanged
+    int repeatedFailures = 0;
+    std::string lastFailure;
+    CandidateRanking ranking(keptCandidates);
+    std::optional<std::string> stopReason;
+    int failedGenerations = 0;
 
-    while (true) {
+    // the stress tests and the shrinking between rounds count against the budget too
+    CheckBudget checks(spent, problem.cancelled);
+    SessionJournal journal;
+    SeenCandidates seen;
+    std::vector<nlohmann::json> session;
+    // candidates of the round the resumed session was interrupted in, by index
+    std::map<int, nlohmann::json> answered;
+    if (!journalName.empty()) {
+        std::string journalPath = problemOutput(problem, journalName);
+        if (resumeSession) {
+            session = SessionJournal::lastSession(journalPath);
+        }
+        if (!journal.open(journalPath)) {
+            LOG("Couldn't open the session journal " + journalPath + "\n", 1);
+        }
+    }
+    if (!session.empty()) {
+        const nlohmann::json *lastRound = nullptr;
+        std::map<int, const nlohmann::json *> rounds;
+        std::map<std::pair<int, int>, const nlohmann::json *> candidates;
+        for (const nlohmann::json &entry: session) {
+            std::string type = entry.value("type", "");
+            if (type == "round") {
+                lastRound = &entry;
+                rounds[entry.value("round", 0)] = &entry;
+            } else if (type == "candidate") {
+                candidates[{entry.value("round", 0), entry.value("index", 0)}] = &entry;
+            } else if (type == "end" && entry.value("solved", false)) {
+                LOG(problem.name + " was solved in the resumed session\n", 1);
+                result.solved = true;
+                result.tries = entry.value("round", 0);
+                result.status = "correct";
+                result.solution = problemOutput(problem, pathToSolution);
+                return result;
+            }
+        }
+        if (lastRound) {
+            const nlohmann::json &round = *lastRound;
+            tries = round.value("round", 0);
+            prompt = round.value("nextPrompt", prompt);
+            stage = round.value("nextStage", stage);
+            repeatedFailures = round.value("repeatedFailures", 0);
+            lastFailure = round.value("lastFailure", "");
+            cascade.restore(round.value("cascadeStep", 0), round.value("cascadeAttempts", 0));
+            spent.restore(tries, round.value("tokens", 0LL), round.value("cpuSeconds", 0.0), round.value("seconds", 0.0));
+            options = escalationPolicy.forAttempt(generationOptions, repeatedFailures);
+            // the best candidate is compiled again, its verdict comes from the journal; one that compiled is only
+            // restored with the failing test its repair starts from
+            if (round.contains("best")) {
+                const nlohmann::json &entry = round["best"];
+                auto found = candidates.find({entry.value("round", 0), entry.value("index", 0)});
+                std::string failingTest = entry.value("failingTest", "");
+                if (found != candidates.end() && (!entry.value("compiled", true) || !failingTest.empty())) {
+                    Attempt best;
+                    best.files = std::make_shared<Workspace>(workspaceRoot, keepWorkspaces);
+                    std::ofstream(best.files->solution) << found->second->value("response", "");
+                    destray(best.files->solution, generationOptions.codeOnly);
+                    best.compilation = compileSolution(best.files->solution, best.files->compileErrors, best.files->compiled);
+                    best.test = TestResult(entry.value("status", "") == "run failed" ? RunFailed : Incorrect);
+                    if (!failingTest.empty()) {
+                        best.test.failingTest = failingTest;
+                    }
+                    if (best.compilation == CompilationSuccess && best.test.status == Incorrect && best.test.failingTest) {
+                        // the output of the failing test again, for the diff in the repair prompt
+                        runCommand("timeout " + std::to_string(checkTimeLimit) + " " + executable(best.files->compiled) + " < " +
+                                   (fs::path(problem.testsDir) / failingTest).string() + " > " + best.files->output + " 2> /dev/null");
+                    }
+                    best.test.passed = entry.value("passed", 0);
+                    best.test.total = entry.value("total", 0);
+                    best.test.cpuSeconds = entry.value("cpuSeconds", 0.0);
+                    best.test.maxMemoryKb = entry.value("maxMemoryKb", 0L);
+                    ranking.add(best, found->first.first, found->first.second);
+                }
+            }
+        }
+        for (const auto &[key, entry]: candidates) {
+            if (key.first == tries + 1) {
+                answered[key.second] = *entry;
+            }
+        }
+        if (deduplicateCandidates) {
+            // the candidates of the finished rounds are known programs again, with the verdicts of their rounds
+            Workspace scratch(workspaceRoot, keepWorkspaces);
+            for (const auto &[key, entry]: candidates) {
+                auto round = rounds.find(key.first);
+                if (round == rounds.end() || !round->second->contains("candidates") ||
+                    key.second >= (int) (*round->second)["candidates"].size()) {
+                    continue;
+                }
+                const nlohmann::json &verdict = (*round->second)["candidates"][key.second];
+                if (verdict.value("cancelled", false) || verdict.value("generationFailed", false)) {
+                    continue;
+                }
+                std::ofstream(scratch.solution) << entry->value("response", "");
+                destray(scratch.solution, generationOptions.codeOnly);
+                std::string status = verdict.value("status", "");
+                TestResult test(status == "correct" ? Correct : status == "run failed" ? RunFailed : Incorrect);
+                if (!verdict.value("failingTest", "").empty()) {
+                    test.failingTest = verdict.value("failingTest", "");
+                }
+                test.passed = verdict.value("passed", 0);
+                test.total = verdict.value("total", 0);
+                seen.record(codeFingerprint(getStringWithFileContents(scratch.solution), fingerprintRenaming),
+                            verdict.value("compiled", false) ? CompilationSuccess : CompilationFailed, test);
+            }
+        }
+        LOG("Resuming " + problem.name + " after " + std::to_string(tries) + " rounds, " + std::to_string(answered.size()) +
+            " candidates of the next one are already generated\n", 1);
+        journal.append({{"type", "resume"}, {"round", tries}});
+        if (saveSlots) {
+            transferSlots(*tokenizer, problem, true);
+        }
+    } else {
+        journal.append({{"type", "start"}, {"problem", problem.name}, {"time", (long long) time(nullptr)}, {"prompt", prompt}, {"stage", stage}});
+    }
+
+    while (!(stopReason = spent.exhausted())) {
         tries++;
 
-        CompilationResult compilationResult = compileSolution(pathToSolution, compileErrorsPath, pathToCompiledSolution);
-        std::string solutionString = getStringWithFileContents(pathToSolution);
+        std::string model = cascade.model();
+        std::string roundStage = stage;
+        std::vector<Attempt> attempts = runRound(problem, model, prompt, options, stage, &journal, tries, answered,
+                                                 deduplicateCandidates ? &seen : nullptr, &spent);
+        answered.clear();
+        long long roundTokens = 0;
+        double roundCpuSeconds = 0;
+        for (const Attempt &candidate: attempts) {
+            roundTokens += candidate.generatedTokens;
+            roundCpuSeconds += candidate.test.cpuSeconds;
+        }
+        spent.addRound(roundTokens, roundCpuSeconds);
+        if (problem.cancelled && *problem.cancelled) {
+            stopReason = "cancelled";
+            break;
+        }
+        if (std::all_of(attempts.begin(), attempts.end(), [](const Attempt &candidate) { return candidate.cancelled; })) {
+            // the deadline stopped the round, there is nothing to repair
+            stopReason = spent.exhausted().value_or("ran out of time");
+            break;
+        }
+        int picked = &pickAttempt(attempts) - attempts.data();
+        Attempt attempt = attempts[picked];
+        if (attempt.generationFailed) {
+            // no candidate got an answer, there is nothing to repair and the same prompt is asked again
+            if (maxFailedGenerations > 0 && ++failedGenerations >= maxFailedGenerations) {
+                stopReason = "no answer from the model in " + std::to_string(failedGenerations) + " rounds in a row";
+                break;
+            }
+            // a replay answers the same way every time, a server may be restarting
+            auto pause = std::chrono::seconds(isReplay() ? 0 : std::min(1 << std::min(failedGenerations, 5), 30));
+            LOG("No answer from the model, asking again in " + std::to_string(pause.count()) + " s\n", 1);
+            for (auto until = std::chrono::steady_clock::now() + pause;
+                 std::chrono::steady_clock::now() < until && !(problem.cancelled && *problem.cancelled);) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            continue;
+        }
+        failedGenerations = 0;
+        TestResult &testResult = attempt.test;
+        if (!attempt.cancelled && !attempt.duplicate && attempt.compilation == CompilationSuccess && testResult.status == Correct) {
+            SemaphoreGuard worker(cpuWorkerPool.get());
+            if (std::optional<std::string> failingTest = stressTest(attempt.files->compiled, attempt.files->output, problem.testsDir, &checks)) {
+                testResult.status = Incorrect;
+                testResult.failingTest = failingTest;
+                seen.record(attempt.fingerprint, attempt.compilation, testResult);
+            }
+        }
+        for (const Attempt &candidate: attempts) {
+            if (candidate.generationMs > 0) {
+                cascade.recordCall(model, candidate.generationMs);
+            }
+        }
+        cascade.recordAttempt(model, !attempt.cancelled && attempt.compilation == CompilationSuccess && testResult.status == Correct);
+        if (attempts.size() > 1) {
+            LOG("Candidate " + std::to_string(picked) + " of " + std::to_string(attempts.size()) + " selected.\n", 1);
+        }
+        attempts[picked].test = testResult;
+        for (size_t i = 0; i < attempts.size(); i++) {
+            ranking.add(attempts[i], tries, i);
+        }
+        // the next prompt repairs the best candidate so far, not a worse one of this round
+        if (!attempt.duplicate && !ranking.empty() && attemptRank(ranking.best().attempt) > attemptRank(attempt)) {
+            LOG("Repairing the best candidate so far, candidate " + std::to_string(ranking.best().index) + " of round " +
+                std::to_string(ranking.best().round) + ".\n", 1);
+            attempt = ranking.best().attempt;
+        }
+        const Workspace &files = *attempt.files;
+
+        std::string solutionString = getStringWithFileContents(files.solution);
         std::string userPrompt = "";
 
-        std::string prompt;
-        if (compilationResult == CompilationFailed) {
+        std::string failure;
+        if (attempt.duplicate) {
+            LOG("The candidate repeats an earlier one. Asking for a different approach.\n", 1);
+            std::string verdict = attempt.compilation == CompilationFailed ? "It failed to compile." :
+                                  "It passed " + std::to_string(testResult.passed) + " of " + std::to_string(testResult.total) + " tests" +
+                                  (testResult.status == RunFailed ? ", it failed during the runtime on a test." : ".");
+            failure = "repeated:" + toHex(attempt.fingerprint);
+            stage = "repeated";
+            prompt = createRepeatedSolutionPrompt(countTokens, problemDescription, solutionString, verdict, userPrompt);
+        } else if (attempt.compilation == CompilationFailed) {
             LOG("Compilation failed. Prompting compile errors.\n", 1);
 
-            std::string compileErrors;
-            std::ifstream file(compileErrorsPath);
-            if (file) {
-                std::string line;
-                while (std::getline(file, line)) {
-                    compileErrors += line + '\n';
-                }
-                file.close();
-            }
+            // without the workspace in the paths the log is the same for the same errors, so a repeated failure is
+            // noticed and a replay finds the recorded prompt
+            std::string compileErrors = replaceAll(getStringWithFileContents(files.compileErrors), files.path().string() + "/", "");
             LOG(compileErrors + "\n");
-            prompt = createCompilationFailedPrompt(problemDescription, compileErrors, solutionString, userPrompt);
+            failure = "compilation:" + compileErrors;
+            if (compileErrors.empty()) {
+                // the compiler was stopped before it said anything, there is nothing to repair
+                stage = "initial";
+                prompt = createProblemStatementPrompt(countTokens, problemDescription);
+            } else {
+                stage = "compilation failed";
+                prompt = createCompilationFailedPrompt(countTokens, problemDescription, compileErrors, solutionString, userPrompt);
+            }
         } else {
             LOG("Compilation successful.\n Test results:", 1);
-            TestResult testResult = testSolution(pathToCompiledSolution, pathToDiffOutput);
             if (testResult.status == Correct) {
                 LOG("Correct\n", 1);
-                bye();
-                return 0;
+                std::string solution = problemOutput(problem, pathToSolution);
+                fs::copy_file(files.solution, solution, fs::copy_options::overwrite_existing);
+                fs::copy_file(files.compiled, problemOutput(problem, pathToCompiledSolution), fs::copy_options::overwrite_existing);
+                if (problem.interactive) {
+                    bye();
+                }
+                result.solved = true;
+                result.tries = tries;
+                result.status = "correct";
+                result.solution = solution;
+                result.passed = result.total = testResult.total;
+                result.generatedTokens = spent.tokens();
+                result.testCpuSeconds = spent.cpuSeconds();
+                result.seconds = spent.seconds();
+                result.modelStats = cascade.modelStats();
+                journal.append({{"type", "end"}, {"solved", true}, {"round", tries}, {"seconds", result.seconds}});
+                journal.sync();
+                return result;
+            } else if (!testResult.failingTest) {
+                // the tests were stopped before one failed, there is nothing to show the model
+                LOG("Stopped\n", 1);
+                failure = "stopped";
+                stage = "initial";
+                prompt = createProblemStatementPrompt(countTokens, problemDescription);
             } else if (testResult.status == Incorrect) {
                 LOG("Incorrect\n", 1);
-                prompt = createIncorrectResultPrompt(problemDescription,
-                                                     createDiffPrompt(pathToSatoriGPTOutput, testResult.failingTest.value()),
+                failure = "incorrect:" + testResult.failingTest.value();
+                stage = "incorrect";
+                std::string counterexample;
+                {
+                    SemaphoreGuard worker(cpuWorkerPool.get());
+                    counterexample = minimizeFailingInput(files.compiled, testResult.failingTest.value(), problem.testsDir, &checks);
+                }
+                prompt = createIncorrectResultPrompt(countTokens, problemDescription,
+                                                     counterexample.empty() ? createDiffPrompt(files.output, testResult.failingTest.value(), problem.testsDir) : counterexample,
                                                      solutionString, userPrompt);
                 LOG(prompt+"\n");
             } else if (testResult.status == RunFailed) {
                 LOG("Run failed\n", 1);
-                prompt = createRunFailedPrompt(problemDescription, solutionString, userPrompt);
+                failure = "run failed";
+                stage = "run failed";
+                std::string counterexample;
+                {
+                    SemaphoreGuard worker(cpuWorkerPool.get());
+                    counterexample = minimizeFailingInput(files.compiled, testResult.failingTest.value(), problem.testsDir, &checks);
+                }
+                prompt = createRunFailedPrompt(countTokens, problemDescription, solutionString, userPrompt, counterexample);
             }
         }
+        result.status = attempt.cancelled ? "cancelled" : stage;
         userPrompt = "";
-        if(tries%5 == 0) getUsersPrompt(userPrompt);
-        assistant.prompt(prompt);
-        destray(pathToSolution);
+        if(problem.interactive && tipsEvery > 0 && tries%tipsEvery == 0) getUsersPrompt(userPrompt);
+        repeatedFailures = failure == lastFailure ? repeatedFailures + 1 : 0;
+        lastFailure = failure;
+        if (cascade.afterFailure(repeatedFailures)) {
+            LOG("Escalating to model " + cascade.model() + "\n", 1);
+            // the new model starts with the normal sampling settings
+            repeatedFailures = 0;
+            lastFailure = "";
+        }
+        options = escalationPolicy.forAttempt(generationOptions, repeatedFailures);
+
+        nlohmann::json verdicts = nlohmann::json::array();
+        for (const Attempt &candidate: attempts) {
+            const TestResult &test = candidate.test;
+            verdicts.push_back({
+                {"cancelled", candidate.cancelled}, {"generationFailed", candidate.generationFailed}, {"duplicate", candidate.duplicate}, {"compiled", candidate.compilation == CompilationSuccess},
+                {"status", test.status == Correct ? "correct" : test.status == Incorrect ? "incorrect" : "run failed"},
+                {"failingTest", test.failingTest.value_or("")}, {"passed", test.passed}, {"total", test.total},
+                {"cpuSeconds", test.cpuSeconds}
+            });
+        }
+        nlohmann::json entry = {
+            {"type", "round"}, {"round", tries}, {"model", model}, {"stage", roundStage}, {"picked", picked},
+            {"candidates", verdicts}, {"nextPrompt", prompt}, {"nextStage", stage}, {"repeatedFailures", repeatedFailures},
+            {"lastFailure", lastFailure}, {"cascadeStep", cascade.step()}, {"cascadeAttempts", cascade.attemptsOnStep()},
+            {"tokens", spent.tokens()}, {"cpuSeconds", spent.cpuSeconds()}, {"seconds", spent.seconds()}
+        };
+        if (!ranking.empty()) {
+            const CandidateRanking::Entry &best = ranking.best();
+            const TestResult &test = best.attempt.test;
+            entry["best"] = {
+                {"round", best.round}, {"index", best.index}, {"compiled", best.attempt.compilation == CompilationSuccess},
+                {"status", test.status == Correct ? "correct" : test.status == Incorrect ? "incorrect" : "run failed"},
+                {"failingTest", test.failingTest.value_or("")}, {"passed", test.passed}, {"total", test.total},
+                {"cpuSeconds", test.cpuSeconds}, {"maxMemoryKb", test.maxMemoryKb}
+            };
+        }
+        journal.append(entry);
+        if (saveSlots) {
+            transferSlots(*tokenizer, problem, false);
+        }
+        if (problem.onRound) {
+            bool compiled = !ranking.empty() && ranking.best().attempt.compilation == CompilationSuccess;
+            problem.onRound(entry, compiled ? getStringWithFileContents(ranking.best().attempt.files->solution) : "");
+        }
+    }
+    journal.append({{"type", "end"}, {"solved", false}, {"round", tries}, {"stopReason", *stopReason}});
+    journal.sync();
+    result.tries = tries;
+    result.stopReason = *stopReason;
+    for (const CandidateRanking::Entry &entry: ranking.all()) {
+        LOG("round " + std::to_string(entry.round) + " candidate " + std::to_string(entry.index) + ": passed " +
+            std::to_string(entry.attempt.test.passed) + " of " + std::to_string(entry.attempt.test.total) + " tests, " +
+            std::to_string((int) (entry.attempt.test.cpuSeconds * 1000)) + " ms CPU, " +
+            std::to_string(entry.attempt.test.maxMemoryKb / 1024) + " MB\n", 1);
+    }
+    if (!ranking.empty() && ranking.best().attempt.compilation == CompilationSuccess) {
+        const Attempt &best = ranking.best().attempt;
+        result.solution = problemOutput(problem, pathToSolution);
+        fs::copy_file(best.files->solution, result.solution, fs::copy_options::overwrite_existing);
+        fs::copy_file(best.files->compiled, problemOutput(problem, pathToCompiledSolution), fs::copy_options::overwrite_existing);
+        result.passed = best.test.passed;
+        result.total = best.test.total;
+    }
+    result.generatedTokens = spent.tokens();
+    result.testCpuSeconds = spent.cpuSeconds();
+    result.seconds = spent.seconds();
+    result.modelStats = cascade.modelStats();
+    return result;
+}
+
+// Solves every problem directory of directory, batchProblemsAtOnce at a time. The candidates of all problems go
+// through one pipeline with batchLlmSlots generation workers and batchCpuWorkers compile and test workers, so one
+// problem compiles while another one generates. Every result is appended to results.jsonl in directory as soon as
+// it is known.
+int runBatch(const std::string &directory) {
+    std::vector<Problem> problems;
+    for (const auto &entry: fs::directory_iterator(directory)) {
+        if (!entry.is_directory() || !fs::exists(entry.path() / "problem.txt") || !fs::is_directory(entry.path() / "tests")) {
+            continue;
+        }
+        Problem problem;
+        problem.name = entry.path().filename().string();
+        problem.description = getUsersProblemDescription((entry.path() / "problem.txt").string());
+        problem.testsDir = (entry.path() / "tests").string();
+        problem.workDir = entry.path().string();
+        problem.interactive = false;
+        problems.push_back(problem);
+    }
+    std::sort(problems.begin(), problems.end(), [](const Problem &a, const Problem &b) { return a.name < b.name; });
+    if (problems.empty()) {
+        std::cout << "No problems (directories with problem.txt and tests) in " << directory << std::endl;
+        return 1;
+    }
+
+    int llmSlots = batchLlmSlots > 0 ? batchLlmSlots : std::max(llamaSlots, 1);
+    int cpuWorkers = batchCpuWorkers > 0 ? batchCpuWorkers : std::max<int>(std::thread::hardware_concurrency(), 1);
+    cpuWorkerPool = std::make_unique<Semaphore>(cpuWorkers);
+    candidatePipeline = std::make_unique<CandidatePipeline>(llmSlots, cpuWorkers);
+    int threads = std::min<int>(batchProblemsAtOnce > 0 ? batchProblemsAtOnce : llmSlots + cpuWorkers, problems.size());
+    std::cout << bold << "Solving " << problems.size() << " problems, " << threads << " at once with " << llmSlots
+              << " LLM slots and " << cpuWorkers << " CPU workers" << reset << std::endl;
+
+    Budget limits = budget;
+    if (limits.maxTries == 0) {
+        limits.maxTries = batchMaxTries;
+    }
+    std::vector<ProblemResult> results(problems.size());
+    std::atomic<size_t> next = 0;
+    std::mutex resultsMutex;
+    std::ofstream resultsFile(fs::path(directory) / "results.jsonl", std::ios::app);
+    auto work = [&] {
+        size_t i;
+        while ((i = next++) < problems.size()) {
+            if (problems[i].description.empty()) {
+                results[i].name = problems[i].name;
+                results[i].status = "no description";
+            } else {
+                results[i] = solveProblem(problems[i], limits);
+            }
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            const ProblemResult &result = results[i];
+            std::cout << (result.solved ? green : red) << result.name << ": " << result.status << " after " << result.tries
+                      << " rounds" << (result.stopReason.empty() ? "" : ", stopped: " + result.stopReason) << reset << std::endl;
+            resultsFile << nlohmann::json{
+                {"problem", result.name}, {"solved", result.solved}, {"status", result.status}, {"tries", result.tries},
+                {"seconds", result.seconds}, {"solution", result.solution}, {"stopReason", result.stopReason},
+                {"passed", result.passed}, {"total", result.total}, {"generatedTokens", result.generatedTokens},
+                {"testCpuSeconds", result.testCpuSeconds}
+            }.dump() << std::endl;
+        }
+    };
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++) {
+        workers.emplace_back(work);
+    }
+    for (std::thread &worker: workers) {
+        worker.join();
+    }
+
+    int solved = 0;
+    std::cout << bold << std::left << std::setw(24) << "problem" << std::right << std::setw(10) << "solved" << std::setw(8)
+              << "rounds" << std::setw(12) << "time [s]" << std::setw(10) << "passed" << "  status" << reset << '\n';
+    for (const ProblemResult &result: results) {
+        solved += result.solved;
+        std::cout << std::left << std::setw(24) << result.name << std::right << std::setw(10) << (result.solved ? "yes" : "no")
+                  << std::setw(8) << result.tries << std::setw(12) << std::fixed << std::setprecision(1) << result.seconds
+                  << std::defaultfloat << std::setw(10) << (std::to_string(result.passed) + "/" + std::to_string(result.total))
+                  << "  " << result.status << (result.stopReason.empty() ? "" : " (" + result.stopReason + ")") << '\n';
+    }
+    std::cout << bold << solved << " of " << results.size() << " problems solved" << reset << std::endl;
+    printLatencySummary();
+    printPipelineSummary();
+    printCascadeSummary(results);
+    return solved == (int) results.size() ? 0 : 2;
+}
+
+// a problem submitted to the job server
+struct ServerJob {
+    std::string id;
+    Problem problem;
+    Budget budget;
+    std::atomic<bool> cancelled = false;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    // queued, running, solved, unsolved or cancelled
+    std::string state = "queued";
+    int version = 0;
+    nlohmann::json lastRound = nlohmann::json::object();
+    // served while no solution is written
+    std::string bestCandidate;
+    ProblemResult result;
+
+    bool finished() const {
+        return state != "queued" && state != "running";
+    }
+
+    // call with mutex held
+    nlohmann::json status() const {
+        nlohmann::json status = {{"id", id}, {"state", state}, {"round", lastRound.value("round", 0)}};
+        if (lastRound.contains("best")) {
+            status["passed"] = lastRound["best"].value("passed", 0);
+            status["total"] = lastRound["best"].value("total", 0);
+        }
+        if (finished()) {
+            status["round"] = result.tries;
+            status["solved"] = result.solved;
+            status["passed"] = result.passed;
+            status["total"] = result.total;
+            status["seconds"] = result.seconds;
+            status["stopReason"] = result.stopReason;
+            status["generatedTokens"] = result.generatedTokens;
+        }
+        return status;
+    }
+};
+
+// Keeps solving problems submitted over a local HTTP/JSON API, all jobs share the pipeline, the LLM connections and
+// the compiled test lists of the process:
+//   POST /jobs                {"problem": "...", "tests": [{"input": "...", "output": "..."}] or "testsDir": "...",
+//                              "budget": {"maxTries": 10, "maxSeconds": 600, ...}} -> {"id": "..."}
+//   GET  /jobs                status of every job
+//   GET  /jobs/ID             status of a job
+//   GET  /jobs/ID/events      the status as JSON lines, one after every round until the job is done
+//   GET  /jobs/ID/solution    the solution, the best candidate so far while no solution passed
+//   POST /jobs/ID/cancel      stops the job after the candidates running now (DELETE /jobs/ID does the same)
+class JobServer {
+    std::string directory;
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<ServerJob>> jobs;
+    int submitted = 0;
+    BoundedQueue<std::shared_ptr<ServerJob>> queue{1 << 16};
+    std::vector<std::thread> workers;
+
+    static void update(ServerJob &job, const std::function<void()> &change) {
+        {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            change();
+            job.version++;
+        }
+        job.changed.notify_all();
+    }
+
+    void work() {
+        while (std::optional<std::shared_ptr<ServerJob>> next = queue.pop()) {
+            ServerJob &job = **next;
+            {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (job.state == "cancelled") {
+                    continue;
+                }
+            }
+            update(job, [&] { job.state = "running"; });
+            ProblemResult result = solveProblem(job.problem, job.budget);
+            update(job, [&] {
+                job.result = result;
+                job.state = result.solved ? "solved" : job.cancelled ? "cancelled" : "unsolved";
+            });
+            LOG("Job " + job.id + " " + job.state + " after " + std::to_string(result.tries) + " rounds\n", 1);
+        }
+    }
+
+    std::shared_ptr<ServerJob> find(const std::string &id) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = jobs.find(id);
+        return found == jobs.end() ? nullptr : found->second;
+    }
+
+    // a non-empty array of {"input": "...", "output": "..."}
+    static bool validTests(const nlohmann::json &tests) {
+        return tests.is_array() && !tests.empty() && std::all_of(tests.begin(), tests.end(), [](const nlohmann::json &test) {
+            return test.is_object() && test.contains("input") && test["input"].is_string() &&
+                   test.contains("output") && test["output"].is_string();
+        });
+    }
+
+    void submit(HttpConnection &connection) {
+        nlohmann::json request = nlohmann::json::parse(connection.body, nullptr, false);
+        if (!request.is_object() || !request.contains("problem") || !request["problem"].is_string() ||
+            !(request.contains("tests") ? validTests(request["tests"]) :
+              request.contains("testsDir") && request["testsDir"].is_string() && fs::is_directory(request["testsDir"].get<std::string>()))) {
+            connection.respond(400, "application/json", R"({"error": "expected {\"problem\": \"...\", \"tests\": [{\"input\": \"...\", \"output\": \"...\"}]}"})");
+            return;
+        }
+        auto job = std::make_shared<ServerJob>();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job->id = std::to_string(time(nullptr)) + "-" + std::to_string(++submitted);
+        }
+        fs::path workDir = fs::path(directory) / job->id;
+        fs::create_directories(workDir / "tests");
+        std::ofstream(workDir / "problem.txt") << request["problem"].get<std::string>();
+        if (request.contains("tests")) {
+            int number = 0;
+            for (const nlohmann::json &test: request["tests"]) {
+                std::ostringstream name;
+                name << std::setw(4) << std::setfill('0') << ++number;
+                std::ofstream(workDir / "tests" / (name.str() + ".in")) << test.value("input", "");
+                std::ofstream(workDir / "tests" / (name.str() + ".out")) << test.value("output", "");
+            }
+        }
+        job->problem.name = job->id;
+        job->problem.description = request["problem"];
+        job->problem.testsDir = request.contains("tests") ? (workDir / "tests").string() : request.value("testsDir", "");
+        job->problem.workDir = workDir.string();
+        job->problem.interactive = false;
+        job->problem.cancelled = &job->cancelled;
+        ServerJob *self = job.get();
+        job->problem.onRound = [self](const nlohmann::json &round, const std::string &best) {
+            update(*self, [&] {
+                self->lastRound = round;
+                self->bestCandidate = best;
+            });
+        };
+        job->budget = budget;
+        if (request.contains("budget") && request["budget"].is_object()) {
+            const nlohmann::json &limits = request["budget"];
+            job->budget.maxTries = limits.value("maxTries", job->budget.maxTries);
+            job->budget.maxSeconds = limits.value("maxSeconds", job->budget.maxSeconds);
+            job->budget.maxGeneratedTokens = limits.value("maxGeneratedTokens", job->budget.maxGeneratedTokens);
+            job->budget.maxTestCpuSeconds = limits.value("maxTestCpuSeconds", job->budget.maxTestCpuSeconds);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs[job->id] = job;
+        }
+        queue.push(job);
+        LOG("Job " + job->id + " submitted\n", 1);
+        connection.respond(202, "application/json", nlohmann::json{{"id", job->id}}.dump());
+    }
+
+    void events(HttpConnection &connection, ServerJob &job) {
+        if (!connection.writeHeader(200, "application/x-ndjson")) {
+            return;
+        }
+        int seen = -1;
+        while (true) {
+            std::unique_lock<std::mutex> lock(job.mutex);
+            // a round can take minutes, meanwhile a client that went away is noticed without a write
+            if (!job.changed.wait_for(lock, std::chrono::seconds(1), [&] { return job.version != seen; })) {
+                lock.unlock();
+                if (connection.closed()) {
+                    return;
+                }
+                continue;
+            }
+            seen = job.version;
+            std::string line = job.status().dump() + "\n";
+            bool finished = job.finished();
+            lock.unlock();
+            if (!connection.write(line) || finished) {
+                return;
+            }
+        }
+    }
+
+public:
+    explicit JobServer(std::string directory) : directory(std::move(directory)) {}
+
+    void handle(HttpConnection &connection) {
+        std::string path = connection.path.substr(0, connection.path.find('?'));
+        if (connection.method == "POST" && path == "/jobs") {
+            submit(connection);
+            return;
+        }
+        if (connection.method == "GET" && path == "/jobs") {
+            nlohmann::json all = nlohmann::json::array();
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto &[id, job]: jobs) {
+                std::lock_guard<std::mutex> jobLock(job->mutex);
+                all.push_back(job->status());
+            }
+            connection.respond(200, "application/json", all.dump());
+            return;
+        }
+        if (path.rfind("/jobs/", 0) != 0) {
+            connection.respond(404, "application/json", R"({"error": "not found"})");
+            return;
+        }
+        std::string id = path.substr(6);
+        std::string action;
+        if (size_t slash = id.find('/'); slash != std::string::npos) {
+            action = id.substr(slash + 1);
+            id = id.substr(0, slash);
+        }
+        std::shared_ptr<ServerJob> job = find(id);
+        if (!job) {
+            connection.respond(404, "application/json", R"({"error": "no such job"})");
+        } else if (connection.method == "GET" && action.empty()) {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            connection.respond(200, "application/json", job->status().dump());
+        } else if (connection.method == "GET" && action == "events") {
+            events(connection, *job);
+        } else if (connection.method == "GET" && action == "solution") {
+            std::string solution = problemOutput(job->problem, pathToSolution);
+            std::unique_lock<std::mutex> lock(job->mutex);
+            std::string best = job->bestCandidate;
+            lock.unlock();
+            if (fs::exists(solution)) {
+                connection.respond(200, "text/plain", getStringWithFileContents(solution));
+            } else if (!best.empty()) {
+                connection.respond(200, "text/plain", best);
+            } else {
+                connection.respond(404, "application/json", R"({"error": "no candidate compiled yet"})");
+            }
+        } else if ((connection.method == "POST" && action == "cancel") || (connection.method == "DELETE" && action.empty())) {
+            job->cancelled = true;
+            update(*job, [&] {
+                if (job->state == "queued") {
+                    job->state = "cancelled";
+                }
+            });
+            std::lock_guard<std::mutex> lock(job->mutex);
+            connection.respond(200, "application/json", job->status().dump());
+        } else {
+            connection.respond(404, "application/json", R"({"error": "not found"})");
+        }
+    }
+
+    void start(int threads) {
+        for (int i = 0; i < threads; i++) {
+            workers.emplace_back(&JobServer::work, this);
+        }
+    }
+};
+
+int runServer(int port) {
+    int llmSlots = batchLlmSlots > 0 ? batchLlmSlots : std::max(llamaSlots, 1);
+    int cpuWorkers = batchCpuWorkers > 0 ? batchCpuWorkers : std::max<int>(std::thread::hardware_concurrency(), 1);
+    cpuWorkerPool = std::make_unique<Semaphore>(cpuWorkers);
+    candidatePipeline = std::make_unique<CandidatePipeline>(llmSlots, cpuWorkers);
+    int threads = batchProblemsAtOnce > 0 ? batchProblemsAtOnce : llmSlots + cpuWorkers;
+
+    JobServer jobs(serverDir);
+    HttpServer http([&jobs](HttpConnection &connection) { jobs.handle(connection); });
+    std::string error;
+    if (!http.listen(port, error)) {
+        std::cout << red << "Couldn't start the job server, " << error << reset << std::endl;
+        return 1;
+    }
+    jobs.start(threads);
+    std::cout << bold << "Job server listening on 127.0.0.1:" << port << ", solving " << threads << " problems at once in "
+              << serverDir << reset << std::endl;
+    http.run();
+    return 0;
+}
+
+OptionParser commandLineOptions() {
+    OptionParser options;
+    options.add("backend", backendKind, "ollama, llamacpp, replay or replay-fast (also the first argument)");
+    options.add("url", backendUrl, "server address (several comma separated), or the recordings for replay (also the second argument)");
+    options.add("pool-failures", backendPoolSettings.failuresToOpen, "failures in a row that take a server out for the cooldown");
+    options.add("pool-cooldown", backendPoolSettings.cooldownSeconds, "seconds a failing server is left out");
+    options.add("health-check-seconds", backendPoolSettings.healthCheckSeconds, "seconds between health checks of the servers, 0 for none");
+    options.add("model", usedModel, "model to use");
+    options.add("cascade", "MODEL@N,...", [](const std::string &text) {
+        std::vector<CascadeStep> steps;
+        std::stringstream list(text);
+        std::string step;
+        while (std::getline(list, step, ',')) {
+            size_t at = step.rfind('@');
+            int attempts = 1;
+            if (at != std::string::npos && (!(std::istringstream(step.substr(at + 1)) >> attempts) || attempts < 1)) {
+                return false;
+            }
+            steps.push_back({step.substr(0, at), attempts});
+        }
+        modelCascade = steps;
+        return !steps.empty();
+    }, "models tried in turn, each for N rounds (1 without @N), e.g. codellama:7b@3,codellama:34b");
+    options.add("escalate-after", cascadeRepeatsBeforeEscalation, "the same failure this many times moves to the next model");
+    options.add("raise-temperature-after", escalationPolicy.repeatsBeforeEscalation, "the same failure this many times raises the temperature, 0 for never");
+    options.add("temperature-step", escalationPolicy.temperatureStep, "how much the temperature is raised");
+    options.add("max-temperature", escalationPolicy.maxTemperature, "the temperature isn't raised above this");
+    options.add("base-temperature", escalationPolicy.baseTemperature, "temperature raised from when --temperature isn't given");
+    options.add("problem", problemPath, "problem description");
+    options.add("tests", testsDir, "directory with the .in and .out files");
+    options.add("batch", batchDir, "solve every problem directory in this directory (also the third argument)");
+    options.add("solution", pathToSolution, "where the passing solution is written");
+    options.add("binary", pathToCompiledSolution, "where the passing compiled solution is written");
+    options.add("compile-command", compileCommand, "compiler command with {source} and {binary}");
+    options.add("workspace-root", workspaceRoot, "directory for the per attempt workspaces");
+    options.add("keep-workspaces", keepWorkspaces, "don't remove the workspaces");
+    options.add("verbose", verbose, "0 prints only the results, 2 everything");
+    options.add("non-interactive", nonInteractive, "never ask for tips on stdin");
+    options.add("tips-every", tipsEvery, "rounds between asking for tips, 0 for never");
+    options.add("max-tries", budget.maxTries, "rounds before giving up, 0 for no limit");
+    options.add("max-seconds", budget.maxSeconds, "wall time per problem, 0 for no limit");
+    options.add("max-generated-tokens", budget.maxGeneratedTokens, "tokens generated per problem, 0 for no limit");
+    options.add("max-test-cpu-seconds", budget.maxTestCpuSeconds, "CPU time of the test runs per problem, 0 for no limit");
+    options.add("fail-fast", failFast, "stop testing a candidate at its first failing test");
+    options.add("keep-candidates", keptCandidates, "best candidates kept per problem");
+    options.add("max-failed-generations", maxFailedGenerations, "rounds in a row without an answer before giving up, 0 for no limit");
+    options.add("deduplicate", deduplicateCandidates, "don't test a program again that was already tested");
+    options.add("fingerprint-renaming", fingerprintRenaming, "programs differing only in their names are the same too");
+    options.add("journal", journalName, "session journal next to every solution, empty for none");
+    options.add("resume", resumeSession, "continue the last session in the journal");
+    options.add("save-slots", saveSlots, "save the llama.cpp slots after every round, restored with --resume");
+    options.add("candidates", candidatesPerRound, "candidates generated per round (best-of-N)");
+    options.add("temperature-spread", candidateTemperatureSpread, "candidate i of a round samples with the temperature raised by i times this");
+    options.add("slots", llamaSlots, "parallel slots of the llama.cpp server");
+    options.add("max-tokens", generationOptions.maxTokens, "generated tokens per answer");
+    options.add("context-size", generationOptions.contextSize, "context window of the model");
+    options.add("temperature", generationOptions.temperature, "sampling temperature");
+    options.add("seed", generationOptions.seed, "sampling seed");
+    options.add("code-only", generationOptions.codeOnly, "make the server output only code");
+    options.add("record", recordPath, "record the responses to this file");
+    options.add("response-cache", responseCacheDir, "cache deterministic responses in this directory");
+    options.add("response-cache-mb", "N", [](const std::string &text) {
+        std::istringstream stream(text);
+        uintmax_t megabytes;
+        if (!(stream >> megabytes)) {
+            return false;
+        }
+        responseCacheBytes = megabytes << 20;
+        return true;
+    }, "size of the response cache");
+    options.add("latency-log", latencyLogPath, "append every LLM call to this JSON lines file");
+    options.add("max-diff-hunks", maxDiffHunks, "places where the output differs shown to the model");
+    options.add("max-diff-input-bytes", maxDiffInputBytes, "the input of a failed test is shown up to this size, bigger ones are shrunk");
+    options.add("max-diff-edits", maxDiffEdits, "outputs differing in more lines are shown as replaced");
+    options.add("reference", referenceSolution, "correct (slow) solution for shrinking and stress tests");
+    options.add("validator", inputValidator, "program accepting only valid inputs on stdin");
+    options.add("stress-generator", stressGenerator, "program printing a test for the seed given as its argument");
+    options.add("stress-tests", stressTests, "generated tests compared with the reference");
+    options.add("max-stress-tests-kept", maxStressTestsKept, "failing stress tests kept in a tests directory, the oldest is removed first");
+    options.add("check-time-limit", checkTimeLimit, "seconds for one run when shrinking or stress testing");
+    options.add("minimize-max-tests", minimizeMaxTests, "runs of the solution and the reference when shrinking one test");
+    options.add("batch-at-once", batchProblemsAtOnce, "problems solved at once, 0 for LLM slots + CPU workers");
+    options.add("serve", serverPort, "run the job server on this port");
+    options.add("server-dir", serverDir, "where the job server keeps the problems");
+    options.add("batch-max-tries", batchMaxTries, "rounds per problem in batch mode without --max-tries");
+    options.add("llm-slots", batchLlmSlots, "generations at once in batch mode, 0 for --slots");
+    options.add("cpu-workers", batchCpuWorkers, "compilations and test runs at once in batch mode, 0 for all cores");
+    return options;
+}
+
+int main(int argc, char **argv) {
+    OptionParser options = commandLineOptions();
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--help" || std::string(argv[i]) == "-h") {
+            std::cout << "usage: " << argv[0] << " [backend [url [batch directory]]] [options]" << std::endl;
+            options.printHelp(std::cout);
+            return 0;
+        }
+    }
+    std::vector<std::string> positional;
+    std::string error;
+    if (!options.parseArguments(argc, argv, positional, error)) {
+        std::cout << error << ", see --help" << std::endl;
+        return 1;
+    }
+    if (positional.size() > 0) backendKind = positional[0];
+    if (positional.size() > 1) backendUrl = positional[1];
+    if (positional.size() > 2) batchDir = positional[2];
+    if (!isReplay() && backendUrl.find(',') != std::string::npos && makeBackend(backendKind, "")) {
+        std::vector<std::string> urls;
+        std::stringstream list(backendUrl);
+        std::string url;
+        while (std::getline(list, url, ',')) {
+            if (!url.empty()) {
+                urls.push_back(url);
+            }
+        }
+        backendPool = std::make_unique<BackendPool>(urls, [](const std::string &url) { return makeBackend(backendKind, url, llamaSlots); },
+                                                    backendPoolSettings);
+    }
+    if (!responseCacheDir.empty() && !isReplay()) {
+        responseCache = std::make_unique<ResponseCache>(responseCacheDir, responseCacheBytes);
+    }
+    if (isReplay()) {
+        recordings.load(backendUrl);
+    } else if (!recordPath.empty()) {
+        recordings.load(recordPath);
+    }
+    std::unique_ptr<LLMBackend> backend = createBackend();
+    if (!backend) {
+        std::cout << "Unknown backend " << backendKind << ", use ollama, llamacpp, replay or replay-fast" << std::endl;
+        return 1;
+    }
+
+    if (batchDir.empty() && serverPort == 0) {
+        greetings();
+    }
+
+    if (!backend->healthy()) {
+        std::cout << red << "The " << backend->name() << " server is not reachable" << reset << std::endl;
+        return 1;
+    }
+
+    if (!latencyLogPath.empty() && !latencyLog.open(latencyLogPath)) {
+        std::cout << "Couldn't open " << latencyLogPath << " for the latency log" << std::endl;
+    }
+
+    if (serverPort > 0) {
+        return runServer(serverPort);
+    }
+    if (!batchDir.empty()) {
+        return runBatch(batchDir);
+    }
+
+    std::string problemDescription = getUsersProblemDescription();
+
+    std::string onlyCodePrompt = " Write only the c++ code that will compile.";
+
+    if (problemDescription.empty()) {
+        std::cout<<"Couldn't read problem description!"<<std::endl;
+        return 1;
+    }
+
+    // a single problem generates, compiles and tests all candidates of a round at once
+    candidatePipeline = std::make_unique<CandidatePipeline>(std::max(candidatesPerRound, 1), std::max(candidatesPerRound, 1));
+    Problem problem;
+    problem.name = problemPath;
+    problem.description = problemDescription;
+    problem.testsDir = getUsersPathToTestDir();
+    problem.interactive = !nonInteractive;
+    ProblemResult result = solveProblem(problem);
+    if (!result.solved) {
+        std::cout << red << "No solution passed all tests in " << result.tries << " rounds, stopped: " << result.stopReason << reset << std::endl;
+        if (!result.solution.empty()) {
+            std::cout << yellow << "The best candidate passed " << result.passed << " of " << result.total
+                      << " tests, it is in the file " << result.solution << reset << std::endl;
+        }
     }
+    printLatencySummary();
+    printPipelineSummary();
+    printCascadeSummary({result});
+    return result.solved ? 0 : 1;
 }
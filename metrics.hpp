@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "llamacpp_client/json.hpp"
+
+// Timing of one LLM call. Client-side times are measured around the streaming request,
+// server-side ones are what the server reported (zero if it doesn't).
+struct CallRecord {
+    std::string stage;
+    std::string backend;
+    // the server of a pool that answered, empty without a pool
+    std::string endpoint;
+    std::string model;
+    bool finished = true;
+    double ttftMs = 0;  // time to first token
+    double totalMs = 0;
+    int promptTokens = 0;
+    int cachedPromptTokens = 0;
+    int generatedTokens = 0;
+    double serverPromptMs = 0;
+    double serverGenerationMs = 0;
+
+    // generation speed excluding the prompt evaluation, from the server's numbers when it has them
+    double tokensPerSecond() const {
+        double generationMs = serverGenerationMs > 0 ? serverGenerationMs : totalMs - ttftMs;
+        return generationMs > 0 ? generatedTokens * 1000.0 / generationMs : 0;
+    }
+
+    nlohmann::json toJson() const {
+        return {
+            {"stage", stage}, {"backend", backend}, {"endpoint", endpoint}, {"model", model}, {"finished", finished},
+            {"ttft_ms", ttftMs}, {"total_ms", totalMs},
+            {"prompt_tokens", promptTokens}, {"cached_prompt_tokens", cachedPromptTokens},
+            {"generated_tokens", generatedTokens},
+            {"server_prompt_ms", serverPromptMs}, {"server_generation_ms", serverGenerationMs},
+            {"tokens_per_second", tokensPerSecond()}
+        };
+    }
+};
+
+// Collects the records of a run, optionally appending each one as a JSON line to a file as it arrives.
+// Records come from every candidate thread, so everything is guarded by one mutex.
+class LatencyLog {
+    mutable std::mutex mutex;
+    std::vector<CallRecord> records;
+    std::ofstream jsonLines;
+
+    struct Totals {
+        int calls = 0;
+        std::vector<double> ttfts;
+        double totalMs = 0;
+        long long promptTokens = 0;
+        long long cachedPromptTokens = 0;
+        long long generatedTokens = 0;
+        double generationMs = 0;
+
+        void add(const CallRecord &record) {
+            calls++;
+            ttfts.push_back(record.ttftMs);
+            totalMs += record.totalMs;
+            promptTokens += record.promptTokens;
+            cachedPromptTokens += record.cachedPromptTokens;
+            generatedTokens += record.generatedTokens;
+            generationMs += record.serverGenerationMs > 0 ? record.serverGenerationMs : record.totalMs - record.ttftMs;
+        }
+
+        double percentile(double p) {
+            if (ttfts.empty()) return 0;
+            std::sort(ttfts.begin(), ttfts.end());
+            return ttfts[std::min<size_t>(ttfts.size() - 1, p * ttfts.size())];
+        }
+    };
+
+    static void printRow(std::ostream &out, const std::string &name, Totals totals) {
+        out << std::left << std::setw(20) << name << std::right
+            << std::setw(6) << totals.calls
+            << std::setw(10) << (int) totals.percentile(0.5)
+            << std::setw(10) << (int) totals.percentile(0.95)
+            << std::fixed << std::setprecision(1)
+            << std::setw(11) << totals.totalMs / 1000
+            << std::setw(10) << totals.promptTokens
+            << std::setw(9) << totals.cachedPromptTokens
+            << std::setw(10) << totals.generatedTokens
+            << std::setw(8) << (totals.generationMs > 0 ? totals.generatedTokens * 1000.0 / totals.generationMs : 0.0)
+            << std::defaultfloat << '\n';
+    }
+
+public:
+    bool open(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        jsonLines.open(path, std::ios::app);
+        return (bool) jsonLines;
+    }
+
+    void add(const CallRecord &record) {
+        std::lock_guard<std::mutex> lock(mutex);
+        records.push_back(record);
+        if (jsonLines.is_open()) {
+            jsonLines << record.toJson().dump() << '\n';
+            jsonLines.flush();
+        }
+    }
+
+    std::vector<CallRecord> all() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return records;
+    }
+
+    // one row per stage and one for the whole run
+    void printSummary(std::ostream &out) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (records.empty()) {
+            return;
+        }
+        std::map<std::string, Totals> stages;
+        Totals run;
+        for (const CallRecord &record: records) {
+            stages[record.stage].add(record);
+            run.add(record);
+        }
+        out << std::left << std::setw(20) << "stage" << std::right << std::setw(6) << "calls"
+            << std::setw(10) << "ttft p50" << std::setw(10) << "ttft p95" << std::setw(11) << "total [s]"
+            << std::setw(10) << "prompt" << std::setw(9) << "cached" << std::setw(10) << "generated"
+            << std::setw(8) << "tok/s" << '\n';
+        for (const auto &[stage, totals]: stages) {
+            printRow(out, stage, totals);
+        }
+        printRow(out, "all", run);
+    }
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Zeller's delta debugging (ddmin) over the lines of a failing input. Every round splits the input into
+// n chunks and tests the chunks and their complements on all threads, the first failing one in that order
+// is kept so the result doesn't depend on the scheduling.
+class DeltaDebugger {
+public:
+    // true when the program still fails on the lines, worker is the index of the calling thread so every
+    // thread can use its own files
+    using Test = std::function<bool(const std::vector<std::string> &lines, int worker)>;
+
+private:
+    Test fails;
+    int threads;
+    int maxTests;
+    std::atomic<int> tests = 0;
+    std::function<bool()> stopped;
+
+    bool tooMany() const {
+        return tests >= maxTests || (stopped && stopped());
+    }
+
+    // index of the first failing candidate, candidates.size() when none fails
+    size_t firstFailing(const std::vector<std::vector<std::string>> &candidates) {
+        std::atomic<size_t> next = 0;
+        std::atomic<size_t> found = candidates.size();
+        auto work = [&](int worker) {
+            size_t i;
+            while ((i = next++) < found && !tooMany()) {
+                tests++;
+                if (!fails(candidates[i], worker)) {
+                    continue;
+                }
+                size_t current = found;
+                while (i < current && !found.compare_exchange_weak(current, i));
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int worker = 1; worker < std::min<int>(threads, candidates.size()); worker++) {
+            workers.emplace_back(work, worker);
+        }
+        work(0);
+        for (std::thread &worker: workers) {
+            worker.join();
+        }
+        return found;
+    }
+
+public:
+    DeltaDebugger(Test fails, int threads, int maxTests = 2000)
+            : fails(fails), threads(std::max(threads, 1)), maxTests(maxTests) {}
+
+    // the input must fail the test, the result fails it too and removing any of its chunks at the final
+    // granularity makes it pass (unless maxTests ran out or stopped returned true first)
+    std::vector<std::string> minimize(std::vector<std::string> input, std::function<bool()> stopped = nullptr) {
+        this->stopped = std::move(stopped);
+        size_t n = 2;
+        while (input.size() >= 2 && !tooMany()) {
+            n = std::min(n, input.size());
+            std::vector<std::vector<std::string>> chunks(n);
+            for (size_t i = 0; i < n; i++) {
+                chunks[i].assign(input.begin() + input.size() * i / n, input.begin() + input.size() * (i + 1) / n);
+            }
+            std::vector<std::vector<std::string>> candidates = chunks;
+            // with two chunks the complements are the chunks themselves
+            if (n > 2) {
+                for (size_t i = 0; i < n; i++) {
+                    std::vector<std::string> complement;
+                    for (size_t j = 0; j < n; j++) {
+                        if (j != i) {
+                            complement.insert(complement.end(), chunks[j].begin(), chunks[j].end());
+                        }
+                    }
+                    candidates.push_back(std::move(complement));
+                }
+            }
+
+            size_t failing = firstFailing(candidates);
+            if (failing < n) {
+                input = candidates[failing];
+                n = 2;
+            } else if (failing < candidates.size()) {
+                input = candidates[failing];
+                n = std::max<size_t>(n - 1, 2);
+            } else if (n < input.size()) {
+                n = std::min(n * 2, input.size());
+            } else {
+                break;
+            }
+        }
+        return input;
+    }
+
+    int testsRun() const {
+        return tests;
+    }
+};
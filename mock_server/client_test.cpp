@@ -0,0 +1,140 @@
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "../llamacpp_client/llama_client.hpp"
+
+// Runs LLamaClient against the mock server in every fragment mode: the streamed response has to arrive whole
+// whatever the chunk boundaries are, the timings have to follow the server's pace and a cancel has to end a
+// request promptly. Exits with 1 when a check failed.
+//   client_test [path to mock_server] [port]
+
+const int ttftMs = 100;
+const double tokensPerSecond = 200;
+// quotes, escapes, event syntax and multi-byte characters inside the content, so a parser cutting at the wrong
+// place shows up
+const std::string shortResponse =
+    "```cpp\n#include <cstdio>\nint main() { puts(\"data: {\\\"stop\\\": true}\\n\\n\"); } // π ≤ 10 ✓\n```\n";
+// long enough to still be streaming when it is cancelled
+const std::string longResponse = std::string(4000, 'x');
+
+int failures = 0;
+
+void check(bool condition, const std::string &mode, const std::string &what) {
+    if (!condition) {
+        std::cout << mode << ": FAILED " << what << std::endl;
+        failures++;
+    }
+}
+
+pid_t startServer(const std::string &path, int port, const std::string &mode, const std::string &script) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execl(path.c_str(), path.c_str(), "--port", std::to_string(port).c_str(), "--fragment", mode.c_str(),
+              "--ttft-ms", std::to_string(ttftMs).c_str(), "--tokens-per-second", std::to_string(tokensPerSecond).c_str(),
+              "--script", script.c_str(), (char *) nullptr);
+        _exit(127);
+    }
+    return pid;
+}
+
+// waits until the server accepts connections
+bool waitForServer(int port) {
+    for (int i = 0; i < 100; i++) {
+        int probe = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = htons(port);
+        bool connected = connect(probe, (sockaddr *) &address, sizeof(address)) == 0;
+        close(probe);
+        if (connected) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return false;
+}
+
+void testMode(const std::string &server, int port, const std::string &mode, const std::string &script) {
+    pid_t pid = startServer(server, port, mode, script);
+    std::string address = "127.0.0.1:" + std::to_string(port);
+    LLamaClient client(address);
+    bool up = waitForServer(port) && client.healthy();
+    check(up, mode, "the mock server didn't start on " + address);
+    if (!up) {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+
+    std::string streamed;
+    client.onContent = [&](const std::string &piece) { streamed += piece; };
+    bool ok = false;
+    std::string content = client.prompt("short", GenerationOptions(), -1, &ok);
+    const PromptTimings &timings = client.lastTimings();
+    check(ok, mode, "request failed");
+    check(content == shortResponse, mode, "content differs: " + content);
+    check(streamed == content, mode, "streamed pieces differ from the content");
+    check(timings.predictedN > 0 && timings.tokensEvaluated > 0, mode, "no timings in the final event");
+    check(timings.ttftMs >= ttftMs, mode, "first token after " + std::to_string(timings.ttftMs) + " ms, the server waits " +
+          std::to_string(ttftMs) + " ms");
+    double paced = ttftMs + (timings.predictedN - 1) * 1000 / tokensPerSecond;
+    check(timings.totalMs >= paced * 0.9 && timings.totalMs < paced + 2000, mode,
+          "took " + std::to_string(timings.totalMs) + " ms, the server's pace needs " + std::to_string(paced) + " ms");
+    double totalMs = timings.totalMs;
+    double firstMs = timings.ttftMs;
+
+    // cancelled from another thread while the response is still streaming
+    streamed.clear();
+    ok = true;
+    auto start = std::chrono::steady_clock::now();
+    std::thread request([&] { content = client.prompt("long", GenerationOptions(), -1, &ok); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(ttftMs + 300));
+    auto cancelled = std::chrono::steady_clock::now();
+    client.cancel();
+    request.join();
+    double cancelMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cancelled).count();
+    double streamMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    check(!ok, mode, "a cancelled request reported success");
+    check(longResponse.rfind(content, 0) == 0 && content.size() < longResponse.size(), mode,
+          "cancelled content isn't a part of the response");
+    // curl looks at the cancel at least once a second even while nothing arrives
+    check(cancelMs < 1500, mode, "cancel took " + std::to_string(cancelMs) + " ms");
+    check(streamMs < longResponse.size() / 4 * 1000 / tokensPerSecond, mode, "the cancelled request ran to its end");
+
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    std::cout << mode << ": first token after " << (int) firstMs << " ms, " << (int) totalMs << " ms in total, cancel took "
+              << (int) cancelMs << " ms" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    std::string server = argc > 1 ? argv[1] : "./mock_server";
+    int port = argc > 2 ? std::stoi(argv[2]) : 18080;
+    std::string script = "client_test_script.jsonl";
+    {
+        std::ofstream file(script);
+        file << nlohmann::json{{"match", "short"}, {"response", shortResponse}}.dump() << '\n'
+             << nlohmann::json{{"match", "long"}, {"response", longResponse}}.dump() << '\n';
+    }
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    for (std::string mode: {"none", "bytes:1", "random", "coalesce"}) {
+        testMode(server, port, mode, script);
+    }
+    std::remove(script.c_str());
+    std::cout << (failures ? "FAILED" : "passed") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,288 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include "../http_server.hpp"
+#include "../llamacpp_client/json.hpp"
+
+// Stands in for a llama.cpp server (/completion, /tokenize, /health, /slots) and an ollama server
+// (/api/generate, /) so the clients and the repair loop can be load tested without a model.
+
+struct ScriptedResponse {
+    std::string match; // the response is used for prompts containing this, empty matches every prompt
+    std::string response;
+};
+
+struct Config {
+    int port = 8080;
+    double tokensPerSecond = 50;
+    // simulated prompt evaluation before the first token
+    int ttftMs = 200;
+    // how every event is cut into writes: "none", "bytes:N", "random" or "coalesce" (all events of a response in one write)
+    std::string fragment = "none";
+    std::vector<ScriptedResponse> script;
+};
+
+Config config;
+std::atomic<size_t> nextUnmatched = 0;
+
+const std::string defaultResponse =
+    "```cpp\n"
+    "#include <iostream>\n"
+    "int main() {\n"
+    "    long long n;\n"
+    "    std::cin >> n;\n"
+    "    bool prime = n > 1;\n"
+    "    for (long long d = 2; d * d <= n; d++)\n"
+    "        if (n % d == 0) prime = false;\n"
+    "    std::cout << prime << std::endl;\n"
+    "}\n"
+    "```\n";
+
+// one JSON object per line: {"match": "...", "response": "..."}
+bool loadScript(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        nlohmann::json entry = nlohmann::json::parse(line, nullptr, false);
+        if (entry.is_object()) {
+            config.script.push_back({entry.value("match", ""), entry.value("response", "")});
+        }
+    }
+    return true;
+}
+
+// the first scripted response whose match occurs in the prompt, otherwise the ones without a match in turns
+std::string pickResponse(const std::string &prompt) {
+    std::vector<const ScriptedResponse *> unmatched;
+    for (const ScriptedResponse &scripted: config.script) {
+        if (scripted.match.empty()) {
+            unmatched.push_back(&scripted);
+        } else if (prompt.find(scripted.match) != std::string::npos) {
+            return scripted.response;
+        }
+    }
+    if (unmatched.empty()) {
+        return defaultResponse;
+    }
+    return unmatched[nextUnmatched++ % unmatched.size()]->response;
+}
+
+// pieces of roughly the size of a BPE token, never ending inside a UTF-8 character as the JSON of an event can't hold half of one
+std::vector<std::string> splitTokens(const std::string &text) {
+    std::vector<std::string> tokens;
+    for (size_t i = 0; i < text.size();) {
+        size_t end = std::min(i + 4, text.size());
+        while (end < text.size() && (text[end] & 0xC0) == 0x80) {
+            end++;
+        }
+        tokens.push_back(text.substr(i, end - i));
+        i = end;
+    }
+    return tokens;
+}
+
+// the streamed events of one response, cut into writes the way the fragment mode says
+class FragmentedStream {
+    HttpConnection &connection;
+    std::mt19937 random;
+    std::string coalesced;
+
+public:
+    explicit FragmentedStream(HttpConnection &connection) : connection(connection), random(std::random_device()()) {}
+
+    // returns false once the client went away
+    bool write(const std::string &data) {
+        if (config.fragment == "coalesce") {
+            coalesced += data;
+            return true;
+        }
+        size_t fixed = config.fragment.rfind("bytes:", 0) == 0 ? std::max(1, std::stoi(config.fragment.substr(6))) : 0;
+        if (config.fragment != "random" && fixed == 0) {
+            return connection.write(data);
+        }
+        for (size_t i = 0; i < data.size();) {
+            size_t size = fixed ? fixed : std::uniform_int_distribution<size_t>(1, 16)(random);
+            size = std::min(size, data.size() - i);
+            if (!connection.write(data.substr(i, size))) {
+                return false;
+            }
+            i += size;
+            // without a pause the pieces would be merged again on the way
+            std::this_thread::sleep_for(std::chrono::microseconds(300));
+        }
+        return true;
+    }
+
+    bool flush() {
+        std::string data;
+        data.swap(coalesced);
+        return data.empty() || connection.write(data);
+    }
+};
+
+// streams the tokens at the configured rate, returns how many were sent before the client went away
+template<typename Event>
+size_t streamTokens(FragmentedStream &stream, const std::vector<std::string> &tokens, Event event) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(config.ttftMs));
+    auto interval = std::chrono::duration<double>(config.tokensPerSecond > 0 ? 1.0 / config.tokensPerSecond : 0);
+    auto next = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < tokens.size(); i++) {
+        if (i > 0) {
+            next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
+            std::this_thread::sleep_until(next);
+        }
+        if (!stream.write(event(tokens[i]))) {
+            return i;
+        }
+    }
+    return tokens.size();
+}
+
+void completion(HttpConnection &connection, const nlohmann::json &request) {
+    std::string prompt = request.value("prompt", "");
+    std::vector<std::string> tokens = splitTokens(pickResponse(prompt));
+    if (request.contains("n_predict") && request["n_predict"].get<int>() >= 0) {
+        tokens.resize(std::min<size_t>(tokens.size(), request["n_predict"].get<int>()));
+    }
+    bool stream = request.value("stream", false);
+    int promptTokens = prompt.size() / 4 + 1;
+    nlohmann::json timings = {
+        {"prompt_n", promptTokens}, {"prompt_ms", (double) config.ttftMs},
+        {"predicted_n", tokens.size()}, {"predicted_ms", tokens.size() * 1000.0 / std::max(config.tokensPerSecond, 1e-9)}
+    };
+
+    if (!stream) {
+        std::string content;
+        for (const std::string &token: tokens) content += token;
+        std::this_thread::sleep_for(std::chrono::milliseconds(config.ttftMs));
+        connection.respond(200, "application/json", nlohmann::json{
+            {"content", content}, {"stop", true}, {"tokens_evaluated", promptTokens}, {"timings", timings}}.dump());
+        return;
+    }
+
+    if (!connection.writeHeader(200, "text/event-stream")) {
+        return;
+    }
+    FragmentedStream events(connection);
+    size_t sent = streamTokens(events, tokens, [](const std::string &token) {
+        return "data: " + nlohmann::json{{"content", token}, {"stop", false}}.dump() + "\n\n";
+    });
+    if (sent < tokens.size()) {
+        std::cerr << "/completion: client went away after " << sent << " of " << tokens.size() << " tokens" << std::endl;
+        return;
+    }
+    events.write("data: " + nlohmann::json{
+        {"content", ""}, {"stop", true}, {"tokens_evaluated", promptTokens}, {"timings", timings}}.dump() + "\n\n");
+    events.flush();
+}
+
+void generate(HttpConnection &connection, const nlohmann::json &request) {
+    std::string prompt = request.value("prompt", "");
+    std::string model = request.value("model", "mock");
+    std::vector<std::string> tokens = splitTokens(pickResponse(prompt));
+    if (request.contains("options") && request["options"].contains("num_predict")) {
+        int limit = request["options"]["num_predict"];
+        if (limit >= 0) tokens.resize(std::min<size_t>(tokens.size(), limit));
+    }
+    // ollama streams unless told otherwise
+    bool stream = request.value("stream", true);
+    nlohmann::json last = {
+        {"model", model}, {"response", ""}, {"done", true},
+        {"prompt_eval_count", prompt.size() / 4 + 1}, {"eval_count", tokens.size()},
+        {"prompt_eval_duration", config.ttftMs * 1000000LL},
+        {"eval_duration", (long long) (tokens.size() * 1e9 / std::max(config.tokensPerSecond, 1e-9))}
+    };
+
+    if (!stream) {
+        std::string content;
+        for (const std::string &token: tokens) content += token;
+        last["response"] = content;
+        std::this_thread::sleep_for(std::chrono::milliseconds(config.ttftMs));
+        connection.respond(200, "application/json", last.dump());
+        return;
+    }
+
+    if (!connection.writeHeader(200, "application/x-ndjson")) {
+        return;
+    }
+    FragmentedStream lines(connection);
+    size_t sent = streamTokens(lines, tokens, [&](const std::string &token) {
+        return nlohmann::json{{"model", model}, {"response", token}, {"done", false}}.dump() + "\n";
+    });
+    if (sent < tokens.size()) {
+        std::cerr << "/api/generate: client went away after " << sent << " of " << tokens.size() << " tokens" << std::endl;
+        return;
+    }
+    lines.write(last.dump() + "\n");
+    lines.flush();
+}
+
+void serve(HttpConnection &connection) {
+    const std::string &method = connection.method;
+    const std::string &path = connection.path;
+    const std::string &body = connection.body;
+    nlohmann::json request = body.empty() ? nlohmann::json::object() : nlohmann::json::parse(body, nullptr, false);
+    if (request.is_discarded()) {
+        connection.respond(400, "application/json", R"({"error": "invalid JSON"})");
+    } else if (method == "POST" && path == "/completion") {
+        completion(connection, request);
+    } else if (method == "POST" && path == "/api/generate") {
+        generate(connection, request);
+    } else if (method == "POST" && path == "/tokenize") {
+        size_t count = splitTokens(request.value("content", "")).size();
+        nlohmann::json tokens = nlohmann::json::array();
+        for (size_t i = 0; i < count; i++) tokens.push_back(i);
+        connection.respond(200, "application/json", nlohmann::json{{"tokens", tokens}}.dump());
+    } else if (method == "POST" && path.rfind("/slots/", 0) == 0) {
+        connection.respond(200, "application/json", R"({"n_saved": 0, "n_restored": 0})");
+    } else if (method == "GET" && path == "/health") {
+        connection.respond(200, "application/json", R"({"status": "ok"})");
+    } else if (method == "GET" && path == "/") {
+        connection.respond(200, "text/plain", "Ollama is running");
+    } else {
+        connection.respond(404, "application/json", R"({"error": "not found"})");
+    }
+}
+
+void usage() {
+    std::cout << "usage: mock_server [--port N] [--tokens-per-second X] [--ttft-ms N]\n"
+                 "                   [--fragment none|bytes:N|random|coalesce] [--script responses.jsonl]\n";
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        std::string value = i + 1 < argc ? argv[i + 1] : "";
+        if (arg == "--port") config.port = std::stoi(value), i++;
+        else if (arg == "--tokens-per-second") config.tokensPerSecond = std::stod(value), i++;
+        else if (arg == "--ttft-ms") config.ttftMs = std::stoi(value), i++;
+        else if (arg == "--fragment") config.fragment = value, i++;
+        else if (arg == "--script") {
+            if (!loadScript(value)) {
+                std::cerr << "Couldn't read " << value << std::endl;
+                return 1;
+            }
+            i++;
+        } else {
+            usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    HttpServer server(serve);
+    std::string error;
+    if (!server.listen(config.port, error)) {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+    std::cout << "mock server listening on 127.0.0.1:" << config.port << std::endl;
+    server.run();
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Builds a prompt out of sections so that it fits into a token budget. Sections that can't be shortened
+// (instructions, the problem, the code) are kept whole when possible, what is left of the budget is split
+// evenly between the shortenable ones (logs, test output) and a section needing less than its share
+// passes the rest on to the others.
+class PromptBuilder {
+public:
+    // tokens of a text as the model's tokenizer counts them
+    using TokenCounter = std::function<int(const std::string &)>;
+
+    enum Truncation {
+        Keep,   // shortened only when the kept sections alone don't fit
+        Head,   // keeps the beginning, e.g. compiler output where the first errors matter most
+        Middle  // keeps the beginning and the end
+    };
+
+private:
+    struct Section {
+        std::string text;
+        Truncation truncation;
+        int tokens = 0;
+    };
+
+    int budget;
+    TokenCounter countTokens;
+    std::vector<Section> sections;
+
+    static std::string cut(const std::string &text, size_t chars, Truncation truncation) {
+        if (chars >= text.size()) {
+            return text;
+        }
+        if (truncation != Middle) {
+            // end at a line break so no half line is shown
+            size_t end = text.rfind('\n', chars);
+            end = end == std::string::npos || end < chars / 2 ? chars : end + 1;
+            return text.substr(0, end) + "\n... (truncated)\n";
+        }
+        size_t head = chars * 2 / 3;
+        size_t tail = chars - head;
+        std::string omitted = text.substr(head, text.size() - head - tail);
+        int lines = std::count(omitted.begin(), omitted.end(), '\n');
+        return text.substr(0, head) + "\n... (" + std::to_string(lines) + " lines omitted) ...\n" + text.substr(text.size() - tail);
+    }
+
+    // shortens the section to at most limit tokens, the characters per token ratio of the text guides the cut
+    // and a few recounts correct it
+    void shorten(Section &section, int limit) {
+        if (section.tokens <= limit) {
+            return;
+        }
+        if (limit <= 0) {
+            section.text.clear();
+            section.tokens = 0;
+            return;
+        }
+        std::string original = section.text;
+        double chars = (double) original.size() * limit / section.tokens * 0.97;
+        for (int i = 0; i < 4 && section.tokens > limit; i++) {
+            section.text = cut(original, (size_t) chars, section.truncation);
+            section.tokens = countTokens(section.text);
+            chars *= std::min(0.95, (double) limit / std::max(section.tokens, 1) * 0.97);
+        }
+        if (section.tokens > limit) {
+            section.text.clear();
+            section.tokens = 0;
+        }
+    }
+
+    // splits budget between the sections, the ones needing less than an equal share keep all of theirs
+    void fit(std::vector<Section *> group, int budget) {
+        std::sort(group.begin(), group.end(), [](Section *a, Section *b) { return a->tokens < b->tokens; });
+        for (size_t i = 0; i < group.size(); i++) {
+            int share = std::max(0, budget) / (int) (group.size() - i);
+            shorten(*group[i], share);
+            budget -= group[i]->tokens;
+        }
+    }
+
+public:
+    PromptBuilder(int budget, TokenCounter countTokens)
+            : budget(budget), countTokens(countTokens) {}
+
+    PromptBuilder &add(std::string text, Truncation truncation = Keep) {
+        if (!text.empty()) {
+            sections.push_back({std::move(text), truncation});
+        }
+        return *this;
+    }
+
+    std::string build() {
+        std::string prompt;
+        for (const Section &section: sections) {
+            prompt += section.text;
+        }
+        // most prompts fit, that takes a single count
+        if (countTokens(prompt) <= budget) {
+            return prompt;
+        }
+
+        std::vector<Section *> kept;
+        std::vector<Section *> shortenable;
+        int keptTokens = 0;
+        for (Section &section: sections) {
+            section.tokens = countTokens(section.text);
+            if (section.truncation == Keep) {
+                kept.push_back(&section);
+                keptTokens += section.tokens;
+            } else {
+                shortenable.push_back(&section);
+            }
+        }
+        if (keptTokens > budget) {
+            for (Section *section: kept) {
+                section->truncation = Middle;
+            }
+            fit(kept, budget);
+            keptTokens = 0;
+            for (Section *section: kept) {
+                keptTokens += section->tokens;
+            }
+        }
+        fit(shortenable, budget - keptTokens);
+
+        prompt.clear();
+        for (const Section &section: sections) {
+            prompt += section.text;
+        }
+        return prompt;
+    }
+};
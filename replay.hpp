@@ -0,0 +1,270 @@
+#pragma once
+
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "backend.hpp"
+#include "hashing.hpp"
+
+// One streamed response: every piece with the time since the previous one (the first since the request was sent).
+struct Recording {
+    std::vector<std::pair<double, std::string>> pieces;
+    GenerationStats stats;
+    bool finished = true;
+};
+
+// Identifies a request, the prompt itself is stored only as its hash.
+inline std::string recordingKey(const std::string &model, const std::string &prompt, const GenerationOptions &options) {
+    return toHex(fnv1a(prompt, fnv1a(options.toJson().dump(), fnv1a(model))));
+}
+
+inline std::string tokenCountKey(const std::string &model, const std::string &text) {
+    return toHex(fnv1a(text, fnv1a(model)));
+}
+
+// Recorded responses kept in a JSON lines file, one response per line. The same request can be recorded
+// several times (the loop asks again after an identical failure), replay serves them in the recorded order
+// and keeps serving the last one after that. The token counts the prompts were shortened with are kept too, so
+// a replay shortens them the same way and asks for the recorded prompts.
+class RecordingStore {
+    std::mutex mutex;
+    std::string path;
+    std::map<std::string, std::vector<Recording>> recordings;
+    std::map<std::string, size_t> served;
+    std::map<std::string, int> tokenCounts;
+
+    void appendLine(const nlohmann::json &entry) {
+        std::ofstream file(path, std::ios::app);
+        file << entry.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) << '\n';
+    }
+
+public:
+    bool load(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->path = path;
+        std::ifstream file(path);
+        if (!file) {
+            return false;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            nlohmann::json entry = nlohmann::json::parse(line, nullptr, false);
+            if (!entry.is_object()) {
+                continue;
+            }
+            if (entry.contains("tokens")) {
+                tokenCounts[entry["key"]] = entry["tokens"];
+                continue;
+            }
+            Recording recording;
+            for (const auto &piece: entry["pieces"]) {
+                recording.pieces.emplace_back(piece[0].get<double>(), piece[1].get<std::string>());
+            }
+            recording.finished = entry.value("finished", true);
+            const nlohmann::json &stats = entry["stats"];
+            recording.stats.promptTokens = stats.value("prompt_tokens", 0);
+            recording.stats.cachedPromptTokens = stats.value("cached_prompt_tokens", 0);
+            recording.stats.generatedTokens = stats.value("generated_tokens", 0);
+            recording.stats.promptMs = stats.value("prompt_ms", 0.0);
+            recording.stats.generationMs = stats.value("generation_ms", 0.0);
+            recordings[entry["key"]].push_back(std::move(recording));
+        }
+        return true;
+    }
+
+    // new recordings are appended to the file given to load
+    void append(const std::string &key, const std::string &model, const GenerationOptions &options, const Recording &recording) {
+        nlohmann::json pieces = nlohmann::json::array();
+        for (const auto &[delay, text]: recording.pieces) {
+            pieces.push_back({delay, text});
+        }
+        nlohmann::json entry = {
+            {"key", key}, {"model", model}, {"options", options.toJson()}, {"finished", recording.finished},
+            {"stats", {
+                {"prompt_tokens", recording.stats.promptTokens},
+                {"cached_prompt_tokens", recording.stats.cachedPromptTokens},
+                {"generated_tokens", recording.stats.generatedTokens},
+                {"prompt_ms", recording.stats.promptMs},
+                {"generation_ms", recording.stats.generationMs}
+            }},
+            {"pieces", pieces}
+        };
+
+        std::lock_guard<std::mutex> lock(mutex);
+        recordings[key].push_back(recording);
+        appendLine(entry);
+    }
+
+    void appendTokenCount(const std::string &key, int tokens) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = tokenCounts.find(key);
+        if (found != tokenCounts.end() && found->second == tokens) {
+            return;
+        }
+        tokenCounts[key] = tokens;
+        appendLine({{"key", key}, {"tokens", tokens}});
+    }
+
+    std::optional<int> tokenCount(const std::string &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = tokenCounts.find(key);
+        if (found == tokenCounts.end()) {
+            return std::nullopt;
+        }
+        return found->second;
+    }
+
+    std::optional<Recording> next(const std::string &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = recordings.find(key);
+        if (found == recordings.end()) {
+            return std::nullopt;
+        }
+        size_t &index = served[key];
+        const Recording &recording = found->second[std::min(index, found->second.size() - 1)];
+        index++;
+        return recording;
+    }
+
+    bool empty() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return recordings.empty();
+    }
+};
+
+// Passes everything to the wrapped backend and stores every finished generation in the store.
+class RecordingBackend : public LLMBackend {
+    std::unique_ptr<LLMBackend> backend;
+    RecordingStore &store;
+
+public:
+    RecordingBackend(std::unique_ptr<LLMBackend> backend, RecordingStore &store) : backend(std::move(backend)), store(store) {}
+
+    std::string name() const override {
+        return backend->name();
+    }
+
+    bool lastFailureRetryable() const override {
+        return backend->lastFailureRetryable();
+    }
+
+    std::string endpoint() const override {
+        return backend->endpoint();
+    }
+
+    bool generate(const std::string &model, const std::string &prompt, const GenerationOptions &options,
+                  const TokenCallback &onToken) override {
+        Recording recording;
+        auto last = std::chrono::steady_clock::now();
+        recording.finished = backend->generate(model, prompt, options, [&](const std::string &piece) {
+            auto now = std::chrono::steady_clock::now();
+            recording.pieces.emplace_back(std::chrono::duration<double, std::milli>(now - last).count(), piece);
+            last = now;
+            onToken(piece);
+        });
+        // a cancelled generation is not what the model would have answered
+        if (recording.finished) {
+            recording.stats = backend->lastStats();
+            store.append(recordingKey(model, prompt, options), model, options, recording);
+        }
+        return recording.finished;
+    }
+
+    std::vector<int> tokenize(const std::string &model, const std::string &text) override {
+        return backend->tokenize(model, text);
+    }
+
+    int countTokens(const std::string &model, const std::string &text) override {
+        int tokens = backend->countTokens(model, text);
+        store.appendTokenCount(tokenCountKey(model, text), tokens);
+        return tokens;
+    }
+
+    void cancel() override {
+        backend->cancel();
+    }
+
+    bool healthy() override {
+        return backend->healthy();
+    }
+
+    GenerationStats lastStats() const override {
+        return backend->lastStats();
+    }
+
+    void setAffinityKey(const std::string &key) override {
+        backend->setAffinityKey(key);
+    }
+    bool saveCache(const std::string &file) override {
+        return backend->saveCache(file);
+    }
+
+    bool restoreCache(const std::string &file) override {
+        return backend->restoreCache(file);
+    }
+};
+
+// Serves recorded responses without any model, with the recorded delays between pieces or as fast as possible.
+class ReplayBackend : public LLMBackend {
+    RecordingStore &store;
+    bool originalLatency;
+    std::atomic<bool> cancelled = false;
+    GenerationStats stats;
+
+public:
+    ReplayBackend(RecordingStore &store, bool originalLatency = true) : store(store), originalLatency(originalLatency) {}
+
+    std::string name() const override {
+        return "replay";
+    }
+
+    bool generate(const std::string &model, const std::string &prompt, const GenerationOptions &options,
+                  const TokenCallback &onToken) override {
+        cancelled = false;
+        stats = GenerationStats();
+        std::optional<Recording> recording = store.next(recordingKey(model, prompt, options));
+        if (!recording) {
+            std::cerr << "no recorded response for this prompt" << std::endl;
+            return false;
+        }
+        for (const auto &[delay, piece]: recording->pieces) {
+            if (originalLatency) {
+                std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(delay));
+            }
+            if (cancelled) {
+                return false;
+            }
+            onToken(piece);
+        }
+        stats = recording->stats;
+        return recording->finished && !cancelled;
+    }
+
+    std::vector<int> tokenize(const std::string &model, const std::string &text) override {
+        return {};
+    }
+
+    // as recorded, the estimate for texts that weren't counted while recording
+    int countTokens(const std::string &model, const std::string &text) override {
+        return store.tokenCount(tokenCountKey(model, text)).value_or(text.size() / 4 + 1);
+    }
+
+    void cancel() override {
+        cancelled = true;
+    }
+
+    bool healthy() override {
+        return !store.empty();
+    }
+
+    GenerationStats lastStats() const override {
+        return stats;
+    }
+};
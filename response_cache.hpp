@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "backend.hpp"
+#include "hashing.hpp"
+
+// Responses stored as one file per request in a directory, the least recently used ones are removed
+// once the directory grows over maxBytes.
+class ResponseCache {
+    std::mutex mutex;
+    std::filesystem::path directory;
+    uintmax_t maxBytes;
+    uintmax_t usedBytes = 0;
+
+    // removes the least recently used files until the cache is below 90% of its size, so not every put evicts
+    void evict() {
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+        for (const auto &entry: std::filesystem::directory_iterator(directory)) {
+            files.emplace_back(entry.last_write_time(), entry.path());
+        }
+        std::sort(files.begin(), files.end());
+        for (const auto &[time, path]: files) {
+            if (usedBytes <= maxBytes / 10 * 9) {
+                break;
+            }
+            std::error_code error;
+            uintmax_t size = std::filesystem::file_size(path, error);
+            if (!error && std::filesystem::remove(path, error)) {
+                usedBytes -= std::min(size, usedBytes);
+                evictions++;
+            }
+        }
+    }
+
+public:
+    std::atomic<int> hits = 0;
+    std::atomic<int> misses = 0;
+    std::atomic<int> evictions = 0;
+
+    ResponseCache(const std::string &directory, uintmax_t maxBytes) : directory(directory), maxBytes(maxBytes) {
+        std::filesystem::create_directories(this->directory);
+        for (const auto &entry: std::filesystem::directory_iterator(this->directory)) {
+            usedBytes += entry.file_size();
+        }
+    }
+
+    static std::string key(const std::string &backend, const std::string &model, const GenerationOptions &options,
+                           const std::string &prompt) {
+        return toHex(fnv1a(prompt, fnv1a(options.toJson().dump(), fnv1a(model, fnv1a(backend)))));
+    }
+
+    std::optional<std::string> get(const std::string &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::filesystem::path path = directory / key;
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            misses++;
+            return std::nullopt;
+        }
+        std::stringstream contents;
+        contents << file.rdbuf();
+        // the modification time doubles as the last use for eviction
+        std::error_code error;
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), error);
+        hits++;
+        return contents.str();
+    }
+
+    void put(const std::string &key, const std::string &response) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // written under another name first, a reader must never see half a response
+        std::filesystem::path path = directory / key;
+        std::filesystem::path temporary = directory / (key + ".tmp");
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            file << response;
+        }
+        // a response written again replaces the old file, only the difference is counted
+        std::error_code error;
+        uintmax_t replaced = std::filesystem::file_size(path, error);
+        if (error) {
+            replaced = 0;
+        }
+        std::filesystem::rename(temporary, path, error);
+        if (error) {
+            return;
+        }
+        usedBytes -= std::min(replaced, usedBytes);
+        usedBytes += response.size();
+        if (usedBytes > maxBytes) {
+            evict();
+        }
+    }
+
+    double hitRate() const {
+        int total = hits + misses;
+        return total ? (double) hits / total : 0;
+    }
+};
+
+// Answers repeated requests from the cache. Only used when sampling is deterministic, with a random
+// seed and a non-zero temperature the server would answer differently every time.
+class CachingBackend : public LLMBackend {
+    std::unique_ptr<LLMBackend> backend;
+    ResponseCache &cache;
+    GenerationStats stats;
+
+public:
+    CachingBackend(std::unique_ptr<LLMBackend> backend, ResponseCache &cache) : backend(std::move(backend)), cache(cache) {}
+
+    static bool deterministic(const GenerationOptions &options) {
+        return options.seed.has_value() || (options.temperature.has_value() && *options.temperature == 0);
+    }
+
+    std::string name() const override {
+        return backend->name();
+    }
+
+    bool lastFailureRetryable() const override {
+        return backend->lastFailureRetryable();
+    }
+
+    std::string endpoint() const override {
+        return backend->endpoint();
+    }
+
+    bool generate(const std::string &model, const std::string &prompt, const GenerationOptions &options,
+                  const TokenCallback &onToken) override {
+        if (!deterministic(options)) {
+            stats = GenerationStats();
+            bool finished = backend->generate(model, prompt, options, onToken);
+            stats = backend->lastStats();
+            return finished;
+        }
+
+        std::string key = ResponseCache::key(backend->name(), model, options, prompt);
+        if (std::optional<std::string> cached = cache.get(key)) {
+            // nothing was evaluated or generated by the server
+            stats = GenerationStats();
+            onToken(*cached);
+            return true;
+        }
+        std::string response;
+        bool finished = backend->generate(model, prompt, options, [&](const std::string &piece) {
+            response += piece;
+            onToken(piece);
+        });
+        stats = backend->lastStats();
+        if (finished) {
+            cache.put(key, response);
+        }
+        return finished;
+    }
+
+    std::vector<int> tokenize(const std::string &model, const std::string &text) override {
+        return backend->tokenize(model, text);
+    }
+
+    int countTokens(const std::string &model, const std::string &text) override {
+        return backend->countTokens(model, text);
+    }
+
+    void cancel() override {
+        backend->cancel();
+    }
+
+    bool healthy() override {
+        return backend->healthy();
+    }
+
+    GenerationStats lastStats() const override {
+        return stats;
+    }
+
+    void setAffinityKey(const std::string &key) override {
+        backend->setAffinityKey(key);
+    }
+    bool saveCache(const std::string &file) override {
+        return backend->saveCache(file);
+    }
+
+    bool restoreCache(const std::string &file) override {
+        return backend->restoreCache(file);
+    }
+};
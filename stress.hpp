@@ -0,0 +1,52 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// Runs generated tests with seeds 0..count-1 on all threads and returns the smallest seed the solution fails,
+// seeds after an already found one are skipped so the answer is the same as with a single thread.
+class StressTester {
+public:
+    // true when the solution fails the test generated from seed, worker is the index of the calling thread
+    using Test = std::function<bool(int seed, int worker)>;
+
+private:
+    Test fails;
+    int threads;
+
+public:
+    StressTester(Test fails, int threads) : fails(fails), threads(std::max(threads, 1)) {}
+
+    // stops between seeds once stopped returns true (the problem was cancelled or ran out of its budget), only a
+    // failing seed found by then is returned
+    std::optional<int> run(int count, const std::function<bool()> &stopped = nullptr) {
+        std::atomic<int> next = 0;
+        std::atomic<int> found = count;
+        auto work = [&](int worker) {
+            int seed;
+            while ((seed = next++) < found && !(stopped && stopped())) {
+                if (!fails(seed, worker)) {
+                    continue;
+                }
+                int current = found;
+                while (seed < current && !found.compare_exchange_weak(current, seed));
+            }
+        };
+        std::vector<std::thread> workers;
+        for (int worker = 1; worker < std::min(threads, count); worker++) {
+            workers.emplace_back(work, worker);
+        }
+        work(0);
+        for (std::thread &worker: workers) {
+            worker.join();
+        }
+        if (found < count) {
+            return found.load();
+        }
+        return std::nullopt;
+    }
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <sys/statvfs.h>
+#include <unistd.h>
+
+// A directory of its own for one attempt (its source, binary, compiler log and test output) or one check, removed
+// with everything in it when the workspace is destroyed. Names are unique per process and per workspace, so
+// parallel candidates and several running instances never write to the same file.
+class Workspace {
+    std::filesystem::path directory;
+    bool keep;
+
+    static std::string uniqueName() {
+        static std::atomic<int> created = 0;
+        return "satori_" + std::to_string(getpid()) + "_" + std::to_string(created++);
+    }
+
+public:
+    std::string solution;
+    std::string compiled;
+    std::string compileErrors;
+    std::string diffOutput;
+    std::string output;
+
+    // tmpfs keeps the many small writes and the compiled binaries off the disk, as long as it allows executing them
+    static std::filesystem::path defaultRoot() {
+        struct statvfs info;
+        if (std::filesystem::is_directory("/dev/shm") && access("/dev/shm", W_OK) == 0 &&
+            statvfs("/dev/shm", &info) == 0 && !(info.f_flag & ST_NOEXEC)) {
+            return "/dev/shm";
+        }
+        return std::filesystem::temp_directory_path();
+    }
+
+    // root empty for defaultRoot, keep leaves the files behind for debugging
+    explicit Workspace(const std::string &root = "", bool keep = false)
+            : directory((root.empty() ? defaultRoot() : std::filesystem::path(root)) / uniqueName()), keep(keep) {
+        std::filesystem::create_directories(directory);
+        solution = file("solution.cpp");
+        compiled = file("solution");
+        compileErrors = file("compileErrors.txt");
+        diffOutput = file("diffOutput.txt");
+        output = file("output.out");
+    }
+
+    Workspace(const Workspace &) = delete;
+    Workspace &operator=(const Workspace &) = delete;
+
+    ~Workspace() {
+        if (!keep) {
+            std::error_code error;
+            std::filesystem::remove_all(directory, error);
+        }
+    }
+
+    std::string file(const std::string &name) const {
+        return (directory / name).string();
+    }
+
+    const std::filesystem::path &path() const {
+        return directory;
+    }
+};